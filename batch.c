@@ -0,0 +1,595 @@
+/*************************************************************************
+ *
+ *	File:	batch.c
+ *	Author:  Jing Huang & Liang Wu
+ *
+ *	Description: whole-file coding and the batch mode. Coding one byte costs
+ *  far more than reading it, so rather than queueing reads on the kernel
+ *  the batch keeps one file per thread in flight: while one thread waits
+ *  on a read the others code, and each file is announced to the kernel
+ *  with posix_fadvise() as soon as it is taken, so its pages are read
+ *  ahead while the coder works through the first buffer.
+ *
+ ************************************************************************/
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "batch.h"
+#include "block.h"
+#include "timer.h"
+
+
+/* bytes left in stream from where it is, or -1 when it is not a regular file */
+static long long BatchStreamLength(FILE *stream)
+{
+	struct stat statistics;
+	long long position;
+
+	if (fstat(fileno(stream), &statistics) == -1 || !S_ISREG(statistics.st_mode)
+		|| (position = ftello(stream)) == -1)
+	{
+		return -1;
+	}
+
+	return (long long)statistics.st_size - position;
+}
+
+
+/* read the rest of stream into memory */
+static unsigned char *BatchReadAll(FILE *stream, long long *length)
+{
+	unsigned char *data, *grown;
+	long long capacity, n;
+
+	capacity = BatchStreamLength(stream);
+	if (capacity < BATCH_BUFSIZE)
+	{
+		capacity = BATCH_BUFSIZE;
+	}
+	if ((data = (unsigned char *) malloc (capacity)) == NULL)
+	{
+		printf("BatchReadAll(): fail to allocate input buffer.\n");
+		return NULL;
+	}
+
+	*length = 0;
+	while ((n = fread(data + *length, 1, capacity - *length, stream)) > 0)
+	{
+		*length += n;
+		if (*length == capacity)
+		{
+			capacity *= 2;
+			if ((grown = (unsigned char *) realloc (data, capacity)) == NULL)
+			{
+				printf("BatchReadAll(): fail to allocate input buffer.\n");
+				free(data);
+				return NULL;
+			}
+			data = grown;
+		}
+	}
+	if (ferror(stream))
+	{
+		printf("BatchReadAll(): fail to read input.\n");
+		free(data);
+		return NULL;
+	}
+	return data;
+}
+
+
+/* compress the rest of in onto out, header first, one buffer at a time.
+ * The stream ends in its end code, so the header may leave the length
+ * unknown: a file gives its length up front, a pipe only when it ends
+ * within the first buffer. Returns the bytes written, or -1 */
+long long BatchCompressStream(FILE *in, FILE *out, const BATCHOPTIONS *options, HUFFMANHEADER *header)
+{
+	const HUFFMANENGINE *engine;
+	void *HuffmanCoder = NULL;
+	BLOCKENCODER *BlockCoder = NULL;
+	unsigned char *buffer;
+	long long WriteBytes = -1, ReadBytes;
+	int engineId = options->engine;
+	int readTimer = TimerId("enc.read");
+	int codeTimer = TimerId("enc.code");
+	int i, n, result = 0;
+
+	if ((buffer = (unsigned char *) malloc (BATCH_BUFSIZE)) == NULL)
+	{
+		printf("BatchCompressStream(): fail to allocate buffer.\n");
+		return -1;
+	}
+	if ((header->length = BatchStreamLength(in)) != -1)
+	{
+		/* the whole file is read once, front to back */
+		posix_fadvise(fileno(in), 0, 0, POSIX_FADV_SEQUENTIAL);
+		posix_fadvise(fileno(in), 0, 0, POSIX_FADV_WILLNEED);
+	}
+
+	/* the first buffer doubles as the sample of auto mode */
+	TimerBegin(readTimer);
+	n = fread(buffer, 1, BATCH_BUFSIZE, in);
+	TimerEnd(readTimer);
+	if (header->length == -1)
+	{
+		header->length = n < BATCH_BUFSIZE && feof(in) ? n : HUFFMAN_LENGTH_UNKNOWN;
+	}
+	if (engineId == HUFFMAN_ENGINE_AUTO)
+	{
+		engineId = HuffmanEngineAuto(buffer, n < HUFFMAN_AUTO_SAMPLE ? n : HUFFMAN_AUTO_SAMPLE,
+			HUFFMAN_AUTO_WEIGHTED);
+	}
+	engine = HuffmanEngine(engineId);
+
+	header->engine = engine->id;
+	header->weightLimit = options->weightLimit;
+	header->blockSize = options->blockSize;
+	if (HuffmanHeaderWrite(out, header) == -1)
+	{
+		result = -1;
+	}
+	else if (options->blockSize > 0)
+	{
+		if ((BlockCoder = BLOCKEncoderAlloc(out, engine, options->weightLimit, options->blockSize)) == NULL)
+		{
+			result = -1;
+		}
+	}
+	else if ((HuffmanCoder = engine->EncoderAlloc(out, 1)) == NULL)
+	{
+		result = -1;
+	}
+	else
+	{
+		engine->CoderSetWeightLimit(HuffmanCoder, options->weightLimit);
+	}
+
+	for (ReadBytes = 0; result == 0 && n > 0; )
+	{
+		TimerBegin(codeTimer);
+		if (BlockCoder != NULL)
+		{
+			result = BLOCKEncoderEncode(BlockCoder, buffer, n);
+		}
+		else
+		{
+			for (i = 0; i < n && result == 0; i++)
+			{
+				result = engine->EncoderEncode(HuffmanCoder, buffer[i]);
+			}
+		}
+		TimerEnd(codeTimer);
+		ReadBytes += n;
+
+		TimerBegin(readTimer);
+		n = fread(buffer, 1, BATCH_BUFSIZE, in);
+		TimerEnd(readTimer);
+	}
+	/* a file that changed under us no longer matches its header */
+	if (result == 0 && (ferror(in)
+		|| (header->length != HUFFMAN_LENGTH_UNKNOWN && ReadBytes != header->length)))
+	{
+		printf("BatchCompressStream(): fail to read input.\n");
+		result = -1;
+	}
+
+	if (BlockCoder != NULL)
+	{
+		if (result == 0 && BLOCKEncoderFlush(BlockCoder) == 0)
+		{
+			WriteBytes = BLOCKEncoderBytesWrite(BlockCoder) + HUFFMAN_HEADER_SIZE;
+		}
+		BLOCKEncoderDealloc(BlockCoder);
+	}
+	else if (HuffmanCoder != NULL)
+	{
+		engine->EncoderEnd(HuffmanCoder);
+		engine->EncoderFlush(HuffmanCoder);
+		if (result == 0)
+		{
+			WriteBytes = engine->EncoderBytesWrite(HuffmanCoder) + HUFFMAN_HEADER_SIZE;
+		}
+#ifdef HUFFMAN_STATS
+		if (options->verbose)
+		{
+			fprintf(stderr, "stats: ");
+			HuffmanStatsDump(stderr, engine->CoderStats(HuffmanCoder));
+			fprintf(stderr, "\n");
+		}
+#endif
+		engine->EncoderDealloc(HuffmanCoder);
+	}
+	if (WriteBytes != -1 && (fflush(out) != 0 || ferror(out)))
+	{
+		printf("BatchCompressStream(): fail to write output.\n");
+		WriteBytes = -1;
+	}
+	free(buffer);
+
+	header->length = ReadBytes;
+
+	return WriteBytes;
+}
+
+
+/* decode a block stream: read all of the code, then let threads decode the
+ * blocks straight into the output, mapped in memory when it is a file */
+static int BatchDecodeBlocks(FILE *in, FILE *out, HUFFMANHEADER *header, int threads)
+{
+	unsigned char *input, *output;
+	long long inputLength, bound, length;
+	bool grown, mapped;
+	int codeTimer = TimerId("dec.code");
+	int fd;
+
+	if ((input = BatchReadAll(in, &inputLength)) == NULL)
+	{
+		return -1;
+	}
+	if ((bound = BLOCKDecodeBound(input, inputLength, header)) <= 0)
+	{
+		free(input);
+		header->length = 0;
+		return bound == 0 ? 0 : -1;
+	}
+
+	/* a mapping has to start on a page and be readable, so only a file still
+	 * at its start and open for reading too is mapped; without a length in
+	 * the header it is cut back afterwards */
+	fd = fileno(out);
+	grown = fflush(out) == 0 && BatchStreamLength(out) == 0 && ftello(out) == 0
+		&& (fcntl(fd, F_GETFL) & O_ACCMODE) == O_RDWR && ftruncate(fd, bound) == 0;
+	mapped = grown && (output = (unsigned char *) mmap (NULL, bound, PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0)) != MAP_FAILED;
+	if (!mapped && (output = (unsigned char *) malloc (bound)) == NULL)
+	{
+		printf("BatchDecodeBlocks(): fail to allocate output buffer.\n");
+		free(input);
+		return -1;
+	}
+
+	TimerBegin(codeTimer);
+	length = BLOCKDecode(input, inputLength, header, output, threads);
+	TimerEnd(codeTimer);
+
+	if (mapped)
+	{
+		munmap(output, bound);
+		if (length != -1 && length < bound && ftruncate(fd, length) == -1)
+		{
+			printf("BatchDecodeBlocks(): fail to write output.\n");
+			length = -1;
+		}
+		fseeko(out, length == -1 ? 0 : length, SEEK_SET);
+	}
+	else
+	{
+		if (length != -1 && (long long)fwrite(output, 1, length, out) != length)
+		{
+			printf("BatchDecodeBlocks(): fail to write output.\n");
+			length = -1;
+		}
+		/* the file was grown for a mapping that failed */
+		if (grown && (fflush(out) != 0 || ftruncate(fd, length == -1 ? 0 : length) == -1))
+		{
+			printf("BatchDecodeBlocks(): fail to write output.\n");
+			length = -1;
+		}
+		free(output);
+	}
+	free(input);
+
+	header->length = length;
+
+	return length == -1 ? -1 : 0;
+}
+
+
+/* decompress in, header first, onto out; returns -1 if in is broken */
+int BatchDecompressStream(FILE *in, FILE *out, const BATCHOPTIONS *options, HUFFMANHEADER *header)
+{
+	const HUFFMANENGINE *engine;
+	void *HuffmanDecoder;
+	unsigned char *buffer;
+	long long count;
+	int codeTimer = TimerId("dec.code");
+	int writeTimer = TimerId("dec.write");
+	int i, written, result = 0;
+
+	posix_fadvise(fileno(in), 0, 0, POSIX_FADV_SEQUENTIAL);
+	posix_fadvise(fileno(in), 0, 0, POSIX_FADV_WILLNEED);
+
+	if (HuffmanHeaderRead(in, header) == -1)
+	{
+		return -1;
+	}
+	engine = HuffmanEngine(header->engine);
+
+	if (header->blockSize > 0)
+	{
+		return BatchDecodeBlocks(in, out, header, options->threads);
+	}
+	/* an empty stream has no code at all, not even the end */
+	if (header->length == 0)
+	{
+		return 0;
+	}
+
+	if ((buffer = (unsigned char *) malloc (BATCH_BUFSIZE)) == NULL)
+	{
+		printf("BatchDecompressStream(): fail to allocate buffer.\n");
+		return -1;
+	}
+	if ((HuffmanDecoder = engine->DecoderAlloc(in, 1)) == NULL)
+	{
+		free(buffer);
+		return -1;
+	}
+	engine->CoderSetWeightLimit(HuffmanDecoder, header->weightLimit);
+
+	/* decode until the end code; a buffer is filled without looking at the
+	 * length, which is checked once the end is found */
+	for (count = 0, i = BATCH_BUFSIZE; result == 0 && i == BATCH_BUFSIZE; count += i)
+	{
+		TimerBegin(codeTimer);
+		i = engine->DecoderDecodeMany(HuffmanDecoder, buffer, BATCH_BUFSIZE);
+		TimerEnd(codeTimer);
+		/* a valid stream never reads past its end code */
+		if (i == -1 || feof(in) || ferror(in))
+		{
+			printf("BatchDecompressStream(): input is corrupt.\n");
+			result = -1;
+			i = 0;
+		}
+		else
+		{
+			TimerBegin(writeTimer);
+			written = (int)fwrite(buffer, 1, i, out);
+			TimerEnd(writeTimer);
+			if (written != i)
+			{
+				printf("BatchDecompressStream(): fail to write output.\n");
+				result = -1;
+			}
+		}
+	}
+	if (result == 0 && header->length != HUFFMAN_LENGTH_UNKNOWN && count != header->length)
+	{
+		printf("BatchDecompressStream(): input ends after %lld of %lld bytes.\n", count, header->length);
+		result = -1;
+	}
+	header->length = count;
+	if (result == 0 && fflush(out) != 0)
+	{
+		printf("BatchDecompressStream(): fail to write output.\n");
+		result = -1;
+	}
+
+	engine->DecoderDealloc(HuffmanDecoder);
+	free(buffer);
+
+	return result;
+}
+
+
+/* code the file inName into outName; a failed output file is removed */
+static int BatchCodeFile(const char *inName, const char *outName, const BATCHOPTIONS *options)
+{
+	FILE *InFile, *OutFile;
+	HUFFMANHEADER header;
+	long long WriteBytes = 0;
+	int result;
+
+	if ((InFile = fopen(inName, "rb")) == NULL)
+	{
+		printf("BatchCodeFile(): fail to open file %s.\n", inName);
+		return -1;
+	}
+	/* read and write, so a block stream can be decoded into the file mapped */
+	if ((OutFile = fopen(outName, options->decompress ? "w+b" : "wb")) == NULL)
+	{
+		printf("BatchCodeFile(): fail to open file %s.\n", outName);
+		fclose(InFile);
+		return -1;
+	}
+	setvbuf(InFile, NULL, _IOFBF, BATCH_BUFSIZE);
+	setvbuf(OutFile, NULL, _IOFBF, BATCH_BUFSIZE);
+
+	if (options->decompress)
+	{
+		result = BatchDecompressStream(InFile, OutFile, options, &header);
+	}
+	else
+	{
+		result = (WriteBytes = BatchCompressStream(InFile, OutFile, options, &header)) == -1 ? -1 : 0;
+	}
+
+	if (fclose(OutFile) != 0 && result == 0)
+	{
+		printf("BatchCodeFile(): fail to write file %s.\n", outName);
+		result = -1;
+	}
+	fclose(InFile);
+
+	if (result == -1)
+	{
+		remove(outName);
+	}
+	else if (options->verbose && options->decompress)
+	{
+		fprintf(stderr, "%s: %s, %lld bytes\n", inName, HuffmanEngine(header.engine)->name, header.length);
+	}
+	else if (options->verbose)
+	{
+		fprintf(stderr, "%s: %s, %lld -> %lld bytes\n", inName, HuffmanEngine(header.engine)->name,
+			header.length, WriteBytes);
+	}
+
+	return result;
+}
+
+
+int BatchCompressFile(const char *inName, const char *outName, const BATCHOPTIONS *options)
+{
+	BATCHOPTIONS fileOptions = *options;
+
+	fileOptions.decompress = false;
+	return BatchCodeFile(inName, outName, &fileOptions);
+}
+
+
+int BatchDecompressFile(const char *inName, const char *outName, const BATCHOPTIONS *options)
+{
+	BATCHOPTIONS fileOptions = *options;
+
+	fileOptions.decompress = true;
+	return BatchCodeFile(inName, outName, &fileOptions);
+}
+
+
+typedef struct
+{
+	char **names;
+	int numNames;
+	const BATCHOPTIONS *options;
+	int next;	/* first file no thread has taken yet */
+	int failed;	/* files that could not be coded */
+	pthread_mutex_t lock;
+}BATCHPOOL;
+
+
+/* name of the file written for names[i]: name.ah when compressing, the name
+ * without .ah when decompressing */
+static char *BatchOutName(const char *name, bool decompress)
+{
+	size_t length = strlen(name), suffix = strlen(BATCH_SUFFIX);
+	char *outName;
+
+	if (decompress)
+	{
+		if (length <= suffix || strcmp(name + length - suffix, BATCH_SUFFIX) != 0)
+		{
+			printf("BatchOutName(): %s does not end in %s.\n", name, BATCH_SUFFIX);
+			return NULL;
+		}
+		if ((outName = (char *) malloc (length - suffix + 1)) == NULL) return NULL;
+		memcpy(outName, name, length - suffix);
+		outName[length - suffix] = '\0';
+	}
+	else
+	{
+		if ((outName = (char *) malloc (length + suffix + 1)) == NULL) return NULL;
+		memcpy(outName, name, length);
+		memcpy(outName + length, BATCH_SUFFIX, suffix + 1);
+	}
+
+	return outName;
+}
+
+
+/* take files in order until none are left; files differ in size, so
+ * handing out the next one on request keeps the threads evenly loaded */
+static void *BatchWorker(void *argument)
+{
+	BATCHPOOL *pool = (BATCHPOOL *)argument;
+	const BATCHOPTIONS *options = pool->options;
+	char *outName;
+	int file, result;
+
+	for ( ; ; )
+	{
+		pthread_mutex_lock(&pool->lock);
+		file = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+
+		if (file >= pool->numNames)
+		{
+			break;
+		}
+
+		result = -1;
+		if ((outName = BatchOutName(pool->names[file], options->decompress)) != NULL)
+		{
+			result = BatchCodeFile(pool->names[file], outName, options);
+			free(outName);
+		}
+		if (result == -1)
+		{
+			pthread_mutex_lock(&pool->lock);
+			pool->failed++;
+			pthread_mutex_unlock(&pool->lock);
+		}
+	}
+	TimerMerge();
+
+	return NULL;
+}
+
+
+/* compress (or decompress) every file in names with up to options->threads
+ * files at once; a failed file does not stop the others; returns the
+ * number of files that failed */
+int BatchRun(char **names, int numNames, const BATCHOPTIONS *options)
+{
+	BATCHPOOL pool;
+	BATCHOPTIONS fileOptions;
+	pthread_t *workers;
+	int i, threads, started;
+
+	threads = options->threads;
+	if (threads <= 0)
+	{
+		threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if (threads > numNames)
+	{
+		threads = numNames;
+	}
+	if (threads < 1)
+	{
+		threads = 1;
+	}
+
+	/* with several files at once the threads are taken, so block streams
+	 * are decoded one thread each */
+	fileOptions = *options;
+	if (threads > 1)
+	{
+		fileOptions.threads = 1;
+	}
+
+	pool.names = names;
+	pool.numNames = numNames;
+	pool.options = &fileOptions;
+	pool.next = 0;
+	pool.failed = 0;
+	pthread_mutex_init(&pool.lock, NULL);
+
+	/* the calling thread is one of the workers */
+	started = 0;
+	workers = (pthread_t *) malloc ((threads - 1) * sizeof(pthread_t) + 1);
+	for (i = 0; workers != NULL && i < threads - 1; i++)
+	{
+		if (pthread_create(&workers[started], NULL, BatchWorker, &pool) == 0)
+		{
+			started++;
+		}
+	}
+	BatchWorker(&pool);
+	for (i = 0; i < started; i++)
+	{
+		pthread_join(workers[i], NULL);
+	}
+
+	free(workers);
+	pthread_mutex_destroy(&pool.lock);
+
+	return pool.failed;
+}
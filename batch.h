@@ -0,0 +1,39 @@
+/*************************************************************************
+ *
+ *	File:	batch.h
+ *	Author:  Jing Huang & Liang Wu
+ *
+ *	Description: compression and decompression of whole streams and files,
+ *  each a header followed by the code, and a batch mode that keeps many
+ *  files going at once on a pool of threads, each thread coding one file
+ *  at a time.
+ *
+ ************************************************************************/
+
+#ifndef __BATCH_H_
+#define __BATCH_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "huffman.h"
+
+#define BATCH_SUFFIX         ".ah"
+#define BATCH_BUFSIZE        (1 << 20)	/* bytes read or written per call */
+
+typedef struct
+{
+	int engine;	/* engine id, or HUFFMAN_ENGINE_AUTO to pick one per file */
+	int weightLimit;
+	int blockSize;	/* 0 = one adaptive stream per file */
+	int threads;	/* files in flight, and threads per block stream, 0 = one per processor */
+	bool decompress;
+	bool verbose;	/* one line per file on stderr */
+}BATCHOPTIONS;
+
+long long BatchCompressStream(FILE *in, FILE *out, const BATCHOPTIONS *options, HUFFMANHEADER *header);
+int BatchDecompressStream(FILE *in, FILE *out, const BATCHOPTIONS *options, HUFFMANHEADER *header);
+int BatchCompressFile(const char *inName, const char *outName, const BATCHOPTIONS *options);
+int BatchDecompressFile(const char *inName, const char *outName, const BATCHOPTIONS *options);
+int BatchRun(char **names, int numNames, const BATCHOPTIONS *options);
+
+#endif
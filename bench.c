@@ -0,0 +1,523 @@
+/*************************************************************************
+ *
+ *	File:	bench.c
+ *	Author:  Jing Huang & Liang Wu
+ *
+ *	Description: benchmark of every engine over a fixed synthetic corpus,
+ *  reported as JSON on stdout. Built on its own, without main.c:
+ *
+ *    gcc -O2 -o bench bench.c huffman.c fgk.c fgkFast.c vitter.c \
+ *        vitterFast.c order1.c rle.c stats.c state.c checkpoint.c iochain.c \
+ *        timer.c perf.c -lpthread
+ *
+ *  usage: bench [--large] [--perf] [--engine name] [--corpus name] [--min-time s]
+ *         bench --replay file...
+ *
+ *  --large adds the 100 MB size. peak_rss_kb is the high-water mark of the
+ *  whole process up to that benchmark. Built with -DHUFFMAN_STATS, records
+ *  of engines that keep counters also carry encode_stats. --perf adds
+ *  hardware counters per symbol where perf_event_open is permitted.
+ *  --replay round trips each file through every engine with HuffmanVerify()
+ *  instead, with and without weight halving; build with -DHUFFMAN_DEBUG to
+ *  also check the trees after every update. -DHUFFMAN_HOT_TOP makes the fast
+ *  decoders walk the top levels of their trees from a small array, rebuilt
+ *  when an update reshapes them, to compare against the plain pointer walk.
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "huffman.h"
+#include "timer.h"
+#include "perf.h"
+
+#define BENCH_NUM_CORPORA   6
+#define BENCH_NUM_SIZES     4
+#define BENCH_LARGE_SIZE    (100 * 1024 * 1024)
+#define BENCH_MIN_TIME      0.2	/* seconds each measurement is repeated for */
+
+typedef struct
+{
+	const char *name;
+	void (*Generate)(unsigned char *buffer, int length);
+}BENCHCORPUS;
+
+/* every corpus is generated from a fixed seed, so runs are reproducible */
+static unsigned int benchSeed;
+
+static unsigned int BenchRandom(void)
+{
+	benchSeed ^= benchSeed << 13;
+	benchSeed ^= benchSeed >> 17;
+	benchSeed ^= benchSeed << 5;
+	return benchSeed;
+}
+
+
+static void GenerateUniform(unsigned char *buffer, int length)
+{
+	int i;
+
+	for (i = 0; i < length; i++)
+	{
+		buffer[i] = (unsigned char)(BenchRandom() >> 24);
+	}
+}
+
+/* byte k drawn with probability proportional to 1 / (k + 1) */
+static void GenerateZipf(unsigned char *buffer, int length)
+{
+	double cdf[256], sum = 0, u;
+	int i, low, high, middle;
+
+	for (i = 0; i < 256; i++)
+	{
+		sum += 1.0 / (i + 1);
+		cdf[i] = sum;
+	}
+
+	for (i = 0; i < length; i++)
+	{
+		u = (BenchRandom() / 4294967296.0) * sum;
+		low = 0;
+		high = 255;
+		while (low < high)
+		{
+			middle = (low + high) / 2;
+			if (cdf[middle] < u) low = middle + 1;
+			else high = middle;
+		}
+		buffer[i] = (unsigned char)low;
+	}
+}
+
+/* sparse binary dump: long zero runs between short records of small values */
+static void GenerateBinary(unsigned char *buffer, int length)
+{
+	int i = 0, run;
+
+	while (i < length)
+	{
+		for (run = BenchRandom() % 512; run > 0 && i < length; run--)
+		{
+			buffer[i++] = 0x00;
+		}
+		for (run = 4 + BenchRandom() % 12; run > 0 && i < length; run--)
+		{
+			buffer[i++] = (BenchRandom() % 4) ? (unsigned char)(BenchRandom() % 16) : 0xff;
+		}
+	}
+}
+
+static const char *benchWords[] =
+{
+	"the", "of", "and", "to", "a", "in", "is", "it", "you", "that", "he", "was",
+	"for", "on", "are", "with", "as", "his", "they", "be", "at", "one", "have",
+	"this", "from", "or", "had", "by", "word", "but", "what", "some", "we",
+	"can", "out", "other", "were", "all", "there", "when", "up", "use", "your",
+	"how", "said", "an", "each", "she", "which", "do", "their", "time", "if",
+	"will", "way", "about", "many", "then", "them", "write", "would", "like",
+	"so", "these", "her", "long", "make", "thing", "see", "him", "two", "has",
+	"look", "more", "day", "could", "go", "come", "did", "number", "sound",
+	"no", "most", "people", "my", "over", "know", "water", "than", "call",
+	"first", "who", "may", "down", "side", "been", "now", "find", "adaptive",
+	"Huffman", "tree", "weight", "symbol", "node", "encoder", "decoder"
+};
+
+/* sentences of common words with a skew towards the first ones */
+static void GenerateEnglish(unsigned char *buffer, int length)
+{
+	int numWords = sizeof(benchWords) / sizeof(benchWords[0]);
+	int i = 0, sentence = 0, word;
+	const char *text;
+
+	while (i < length)
+	{
+		word = (BenchRandom() % numWords) * (BenchRandom() % numWords) / numWords;
+		for (text = benchWords[word]; *text != '\0' && i < length; text++)
+		{
+			buffer[i] = (unsigned char)*text;
+			if (sentence == 0 && text == benchWords[word] && *text >= 'a' && *text <= 'z')
+			{
+				buffer[i] -= 'a' - 'A';
+			}
+			i++;
+		}
+		sentence++;
+		if (i < length && sentence > 6 && BenchRandom() % 6 == 0)
+		{
+			if (BenchRandom() % 4)
+			{
+				buffer[i++] = '.';
+				sentence = 0;
+			}
+			else
+			{
+				buffer[i++] = ',';
+			}
+		}
+		if (i < length)
+		{
+			buffer[i++] = (BenchRandom() % 12 == 0) ? '\n' : ' ';
+		}
+	}
+}
+
+/* one JSON object per line, as a service log would write them */
+static void GenerateJson(unsigned char *buffer, int length)
+{
+	static const char *levels[] = { "info", "info", "info", "debug", "warn", "error" };
+	static const char *services[] = { "auth", "billing", "gateway", "search", "storage" };
+	static const char *messages[] = { "request served", "cache miss", "retrying upstream",
+		"user logged in", "slow query", "connection reset" };
+	char line[256];
+	unsigned int timestamp = 1700000000;
+	int i = 0, n;
+
+	while (i < length)
+	{
+		timestamp += BenchRandom() % 3;
+		n = sprintf(line, "{\"ts\":%u,\"level\":\"%s\",\"service\":\"%s\",\"latency_ms\":%u,"
+			"\"msg\":\"%s\",\"id\":\"%08x\"}\n", timestamp, levels[BenchRandom() % 6],
+			services[BenchRandom() % 5], BenchRandom() % 500, messages[BenchRandom() % 6],
+			BenchRandom());
+		if (n > length - i)
+		{
+			n = length - i;
+		}
+		memcpy(buffer + i, line, n);
+		i += n;
+	}
+}
+
+/* stands in for already compressed data: full entropy, no structure */
+static void GenerateCompressed(unsigned char *buffer, int length)
+{
+	int i;
+
+	for (i = 0; i < length; i++)
+	{
+		buffer[i] = (unsigned char)(BenchRandom() >> 11);
+	}
+}
+
+static const BENCHCORPUS corpora[BENCH_NUM_CORPORA] =
+{
+	{ "uniform", GenerateUniform },
+	{ "zipf", GenerateZipf },
+	{ "binary", GenerateBinary },
+	{ "english", GenerateEnglish },
+	{ "json", GenerateJson },
+	{ "compressed", GenerateCompressed }
+};
+
+static const int sizes[BENCH_NUM_SIZES] = { 1024, 64 * 1024, 1024 * 1024, BENCH_LARGE_SIZE };
+
+
+static long BenchPeakRss(void)
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) == -1) return 0;
+
+	return usage.ru_maxrss;
+}
+
+/* encode input into output, repeated until minTime has passed;
+ * returns the compressed size and the seconds per pass, and the counters
+ * of the last pass if the engine keeps them */
+static long long BenchEncode(const HUFFMANENGINE *engine, unsigned char *input, int length,
+	unsigned char *output, double minTime, double *seconds, int *iterations, const HUFFMANSTATS **stats,
+	PERFCOUNTERS *perf)
+{
+	static HUFFMANSTATS last;
+
+	void *encoder;
+	long long bytes = 0;
+	double total = 0;
+	int i;
+
+	*iterations = 0;
+	do
+	{
+		encoder = engine->EncoderAlloc(output, 0);
+		if (perf != NULL) PerfStart(perf);
+		StartTimer();
+		for (i = 0; i < length; i++)
+		{
+			engine->EncoderEncode(encoder, input[i]);
+		}
+		engine->EncoderFlush(encoder);
+		StopTimer();
+		if (perf != NULL) PerfStop(perf);
+		total += ElapsedTime();
+		bytes = engine->EncoderBytesWrite(encoder);
+		*stats = NULL;
+		if (engine->CoderStats(encoder) != NULL)
+		{
+			last = *engine->CoderStats(encoder);
+			*stats = &last;
+		}
+		engine->EncoderDealloc(encoder);
+		(*iterations)++;
+	} while (total < minTime);
+
+	*seconds = total / *iterations;
+
+	return bytes;
+}
+
+/* decode length symbols of input, repeated until minTime has passed;
+ * returns false if the last pass does not give back the original */
+static bool BenchDecode(const HUFFMANENGINE *engine, unsigned char *input, int length,
+	unsigned char *original, unsigned char *output, double minTime, double *seconds, int *iterations,
+	PERFCOUNTERS *perf)
+{
+	void *decoder;
+	double total = 0;
+
+	*iterations = 0;
+	do
+	{
+		decoder = engine->DecoderAlloc(input, 0);
+		if (perf != NULL) PerfStart(perf);
+		StartTimer();
+		engine->DecoderDecodeMany(decoder, output, length);
+		StopTimer();
+		if (perf != NULL) PerfStop(perf);
+		total += ElapsedTime();
+		engine->DecoderDealloc(decoder);
+		(*iterations)++;
+	} while (total < minTime);
+
+	*seconds = total / *iterations;
+
+	return memcmp(original, output, length) == 0;
+}
+
+/* counters per symbol, null for those the kernel refused */
+static void BenchPerfDump(const char *key, PERFCOUNTERS *perf, double symbols)
+{
+	int i;
+
+	printf(", \"%s\": {", key);
+	for (i = 0; i < PERF_NUM_EVENTS; i++)
+	{
+		if (perf->value[i] < 0)
+		{
+			printf(" \"%s_per_symbol\": null,", perfEventNames[i]);
+		}
+		else
+		{
+			printf(" \"%s_per_symbol\": %.3f,", perfEventNames[i], perf->value[i] / symbols);
+		}
+	}
+	if (perf->value[PERF_CYCLES] > 0 && perf->value[PERF_INSTRUCTIONS] >= 0)
+	{
+		printf(" \"ipc\": %.3f }", (double)perf->value[PERF_INSTRUCTIONS] / perf->value[PERF_CYCLES]);
+	}
+	else
+	{
+		printf(" \"ipc\": null }");
+	}
+}
+
+/* returns the number of files that fail to round trip */
+static int BenchReplay(int numFiles, char **files)
+{
+	FILE *file;
+	unsigned char *data;
+	long length;
+	int i, failures = 0;
+
+	for (i = 0; i < numFiles; i++)
+	{
+		if ((file = fopen(files[i], "rb")) == NULL)
+		{
+			printf("fail to open file %s.\n", files[i]);
+			failures++;
+			continue;
+		}
+		fseek(file, 0, SEEK_END);
+		length = ftell(file);
+		rewind(file);
+		if ((data = (unsigned char *) malloc (length + 1)) == NULL
+			|| fread(data, 1, length, file) != (size_t)length)
+		{
+			printf("fail to read file %s.\n", files[i]);
+			free(data);
+			fclose(file);
+			failures++;
+			continue;
+		}
+		fclose(file);
+
+		if (HuffmanVerify(data, (int)length, 0) == -1 || HuffmanVerify(data, (int)length, MIN_WEIGHT_LIMIT) == -1)
+		{
+			printf("%s: FAIL\n", files[i]);
+			failures++;
+		}
+		else
+		{
+			printf("%s: ok\n", files[i]);
+		}
+		free(data);
+	}
+
+	return failures;
+}
+
+static double BenchRate(double bytes, double seconds)
+{
+	/* below the timer resolution */
+	if (seconds <= 0) seconds = 1e-9;
+
+	return bytes / (1024.0 * 1024.0) / seconds;
+}
+
+
+int main(int argc, char **argv)
+{
+	const char *engineName = NULL, *corpusName = NULL;
+	const HUFFMANENGINE *engine;
+	unsigned char *input, *encoded, *decoded;
+	double minTime = BENCH_MIN_TIME, encodeSeconds, decodeSeconds;
+	int numSizes = BENCH_NUM_SIZES - 1;
+	int c, s, e, encodeIterations, decodeIterations, length;
+	long long bytes;
+	bool verified, first = true, usePerf = false;
+	PERFCOUNTERS encodePerf, decodePerf;
+	const HUFFMANSTATS *stats;
+
+	for (c = 1; c < argc; c++)
+	{
+		if (strcmp(argv[c], "--large") == 0)
+		{
+			numSizes = BENCH_NUM_SIZES;
+		}
+		else if (strcmp(argv[c], "--perf") == 0)
+		{
+			usePerf = true;
+		}
+		else if (strcmp(argv[c], "--replay") == 0)
+		{
+			return BenchReplay(argc - c - 1, argv + c + 1) ? 1 : 0;
+		}
+		else if (strcmp(argv[c], "--engine") == 0 && c + 1 < argc)
+		{
+			engineName = argv[++c];
+		}
+		else if (strcmp(argv[c], "--corpus") == 0 && c + 1 < argc)
+		{
+			corpusName = argv[++c];
+		}
+		else if (strcmp(argv[c], "--min-time") == 0 && c + 1 < argc)
+		{
+			minTime = atof(argv[++c]);
+		}
+		else
+		{
+			printf("usage: %s [--large] [--perf] [--engine name] [--corpus name] [--min-time seconds]\n"
+				"       %s --replay file...\n", argv[0], argv[0]);
+			return 1;
+		}
+	}
+
+	if (engineName != NULL && HuffmanEngine(HuffmanEngineByName(engineName)) == NULL)
+	{
+		printf("unknown engine %s.\n", engineName);
+		return 1;
+	}
+
+	if (usePerf && (PerfOpen(&encodePerf) == 0 || PerfOpen(&decodePerf) == 0))
+	{
+		fprintf(stderr, "perf counters are not permitted here, continuing without them\n");
+		PerfClose(&encodePerf);
+		usePerf = false;
+	}
+
+	printf("{\n  \"context\": { \"date\": \"%.24s\", \"min_time\": %g },\n  \"benchmarks\": [", today(), minTime);
+
+	for (s = 0; s < numSizes; s++)
+	{
+		length = sizes[s];
+		input = (unsigned char *) malloc (length);
+		decoded = (unsigned char *) malloc (length);
+		/* pages past the real output are never touched */
+		encoded = (unsigned char *) malloc (HuffmanEncodeBound(length));
+		if (input == NULL || decoded == NULL || encoded == NULL)
+		{
+			printf("fail to allocate %d byte buffers.\n", length);
+			return 1;
+		}
+
+		for (c = 0; c < BENCH_NUM_CORPORA; c++)
+		{
+			if (corpusName != NULL && strcmp(corpusName, corpora[c].name) != 0)
+			{
+				continue;
+			}
+			benchSeed = 2463534242u + c;
+			corpora[c].Generate(input, length);
+
+			for (e = 0; e < HUFFMAN_NUM_ENGINES; e++)
+			{
+				engine = HuffmanEngine(e);
+				if (engineName != NULL && strcmp(engineName, engine->name) != 0)
+				{
+					continue;
+				}
+				fprintf(stderr, "%s/%s/%d\n", engine->name, corpora[c].name, length);
+
+				if (usePerf)
+				{
+					PerfReset(&encodePerf);
+					PerfReset(&decodePerf);
+				}
+				bytes = BenchEncode(engine, input, length, encoded, minTime,
+					&encodeSeconds, &encodeIterations, &stats, usePerf ? &encodePerf : NULL);
+				verified = BenchDecode(engine, encoded, length, input, decoded, minTime,
+					&decodeSeconds, &decodeIterations, usePerf ? &decodePerf : NULL);
+
+				printf("%s\n    { \"engine\": \"%s\", \"corpus\": \"%s\", \"size\": %d, "
+					"\"compressed\": %lld, \"ratio\": %.4f, "
+					"\"encode_iterations\": %d, \"encode_mb_s\": %.3f, \"encode_ns_per_symbol\": %.2f, "
+					"\"decode_iterations\": %d, \"decode_mb_s\": %.3f, \"decode_ns_per_symbol\": %.2f, "
+					"\"peak_rss_kb\": %ld, \"verified\": %s",
+					first ? "" : ",", engine->name, corpora[c].name, length,
+					bytes, (double)bytes / length,
+					encodeIterations, BenchRate(length, encodeSeconds), encodeSeconds * 1e9 / length,
+					decodeIterations, BenchRate(length, decodeSeconds), decodeSeconds * 1e9 / length,
+					BenchPeakRss(), verified ? "true" : "false");
+				if (usePerf)
+				{
+					BenchPerfDump("encode_perf", &encodePerf, (double)length * encodeIterations);
+					BenchPerfDump("decode_perf", &decodePerf, (double)length * decodeIterations);
+				}
+#ifdef HUFFMAN_STATS
+				printf(", \"encode_stats\": ");
+				HuffmanStatsDump(stdout, stats);
+#endif
+				printf(" }");
+				fflush(stdout);
+				first = false;
+			}
+		}
+
+		free(input);
+		free(decoded);
+		free(encoded);
+	}
+
+	printf("\n  ]\n}\n");
+
+	if (usePerf)
+	{
+		PerfClose(&encodePerf);
+		PerfClose(&decodePerf);
+	}
+
+	return 0;
+}
@@ -0,0 +1,406 @@
+/*************************************************************************
+ *
+ *	File:	block.c
+ *	Author:  Jing Huang & Liang Wu
+ *
+ *	Description: block stream coding. Blocks share nothing, so the decoder
+ *  finds every block from the size prefixes, knows its output offset from
+ *  the block number, and lets a pool of threads decode them straight into
+ *  the caller's output buffer.
+ *
+ ************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "block.h"
+#include "timer.h"
+#include "iochain.h"
+
+
+BLOCKENCODER *BLOCKEncoderAlloc(FILE *stream, const HUFFMANENGINE *engine, int weightLimit, int blockSize)
+{
+	BLOCKENCODER *encoder;
+
+	if (blockSize <= 0)
+	{
+		printf("BLOCKEncoderAlloc(): bad block size %d.\n", blockSize);
+		return NULL;
+	}
+
+	if ((encoder = (BLOCKENCODER *) malloc (sizeof(BLOCKENCODER))) == NULL)
+	{
+		printf("BLOCKEncoderAlloc(): fail to allocate block encoder.\n");
+		return NULL;
+	}
+
+	encoder->input = (unsigned char *) malloc (blockSize);
+	encoder->output = (unsigned char *) malloc (HuffmanEncodeBound(blockSize));
+	if (encoder->input == NULL || encoder->output == NULL)
+	{
+		printf("BLOCKEncoderAlloc(): fail to allocate block buffers.\n");
+		free(encoder->input);
+		free(encoder->output);
+		free(encoder);
+		return NULL;
+	}
+
+	encoder->engine = engine;
+	encoder->weightLimit = weightLimit;
+	encoder->blockSize = blockSize;
+	encoder->inputLength = 0;
+	encoder->stream = stream;
+	encoder->BytesWrite = 0;
+
+	return encoder;
+}
+
+
+/* code the buffered bytes with a fresh coder and write them out as one block */
+static int BLOCKEncoderWriteBlock(BLOCKENCODER *encoder)
+{
+	const HUFFMANENGINE *engine = encoder->engine;
+	unsigned char prefix[BLOCK_PREFIX_SIZE];
+	void *coder;
+	long long length;
+	int i;
+
+	if ((coder = engine->EncoderAlloc(encoder->output, 0)) == NULL)
+	{
+		return -1;
+	}
+	engine->CoderSetWeightLimit(coder, encoder->weightLimit);
+	for (i = 0; i < encoder->inputLength; i++)
+	{
+		if (engine->EncoderEncode(coder, encoder->input[i]) == -1)
+		{
+			engine->EncoderDealloc(coder);
+			return -1;
+		}
+	}
+	engine->EncoderEnd(coder);
+	engine->EncoderFlush(coder);
+	length = engine->EncoderBytesWrite(coder);
+	engine->EncoderDealloc(coder);
+
+	prefix[0] = (unsigned char)(length >> 24);
+	prefix[1] = (unsigned char)(length >> 16);
+	prefix[2] = (unsigned char)(length >> 8);
+	prefix[3] = (unsigned char)length;
+	if (fwrite(prefix, 1, BLOCK_PREFIX_SIZE, encoder->stream) != BLOCK_PREFIX_SIZE
+		|| (long long)fwrite(encoder->output, 1, length, encoder->stream) != length)
+	{
+		printf("BLOCKEncoderWriteBlock(): fail to write block.\n");
+		return -1;
+	}
+
+	encoder->BytesWrite += BLOCK_PREFIX_SIZE + length;
+	encoder->inputLength = 0;
+
+	return 0;
+}
+
+
+int BLOCKEncoderEncode(BLOCKENCODER *encoder, const unsigned char *data, int length)
+{
+	int n;
+
+	while (length > 0)
+	{
+		n = encoder->blockSize - encoder->inputLength;
+		if (n > length)
+		{
+			n = length;
+		}
+		memcpy(encoder->input + encoder->inputLength, data, n);
+		encoder->inputLength += n;
+		data += n;
+		length -= n;
+
+		if (encoder->inputLength == encoder->blockSize && BLOCKEncoderWriteBlock(encoder) == -1)
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+/* write the last, short block if there is one */
+int BLOCKEncoderFlush(BLOCKENCODER *encoder)
+{
+	if (encoder->inputLength > 0)
+	{
+		return BLOCKEncoderWriteBlock(encoder);
+	}
+
+	return 0;
+}
+
+
+void BLOCKEncoderDealloc(BLOCKENCODER *encoder)
+{
+	free(encoder->input);
+	free(encoder->output);
+	free(encoder);
+}
+
+
+long long BLOCKEncoderBytesWrite(BLOCKENCODER *encoder)
+{
+	return encoder->BytesWrite;
+}
+
+
+typedef struct
+{
+	const HUFFMANHEADER *header;
+	const HUFFMANENGINE *engine;
+	const unsigned char *input;
+	long long inputLength;
+	const long long *offsets;	/* where the code of each block starts in input */
+	unsigned char *output;
+	int numBlocks;
+	long long lastLength;	/* bytes in the last block, -1 until decoded if the header does not tell */
+	int next;	/* first block no thread has taken yet */
+	int failed;
+	pthread_mutex_t lock;
+}BLOCKPOOL;
+
+
+/* every block ends in its end code; all but the last hold blockSize bytes */
+static int BLOCKDecodeBlock(BLOCKPOOL *pool, int block)
+{
+	const HUFFMANENGINE *engine = pool->engine;
+	unsigned char *output;
+	long long length, end, blockSize = pool->header->blockSize;
+	struct iovec code;
+	IOCHAIN chain;
+	void *coder;
+	int i, limit;
+
+	output = pool->output + block * blockSize;
+	length = block < pool->numBlocks - 1 ? blockSize : pool->lastLength;
+	/* output holds no more than the header says */
+	limit = length != -1 ? length : blockSize;
+
+	/* the decoder reads the code through a chain of just this block, so a
+	 * corrupt block reads EOF at its end instead of the next block */
+	end = block < pool->numBlocks - 1 ? pool->offsets[block + 1] - BLOCK_PREFIX_SIZE : pool->inputLength;
+	code.iov_base = (void *)(pool->input + pool->offsets[block]);
+	code.iov_len = end - pool->offsets[block];
+	IOChainInit(&chain, &code, 1);
+
+	if ((coder = engine->DecoderAlloc(&chain, IOCHAIN_STREAM)) == NULL)
+	{
+		return -1;
+	}
+	engine->CoderSetWeightLimit(coder, pool->header->weightLimit);
+	i = engine->DecoderDecodeMany(coder, output, limit);
+	/* a block that fills its space must be followed by its end code */
+	if (i == limit && engine->DecoderDecode(coder) != HUFFMAN_END)
+	{
+		i = -1;
+	}
+	engine->DecoderDealloc(coder);
+	/* a valid block never reads past its end code */
+	if (chain.overrun > 0)
+	{
+		i = -1;
+	}
+
+	if (i <= 0 || (length != -1 && i != length))
+	{
+		printf("BLOCKDecodeBlock(): block %d is corrupt.\n", block);
+		return -1;
+	}
+	if (block == pool->numBlocks - 1)
+	{
+		pool->lastLength = i;
+	}
+
+	return 0;
+}
+
+
+/* take blocks in order until none are left; blocks are of equal size, so
+ * handing out the next one on request keeps the threads evenly loaded */
+static void *BLOCKDecodeWorker(void *argument)
+{
+	BLOCKPOOL *pool = (BLOCKPOOL *)argument;
+	int block;
+
+	for ( ; ; )
+	{
+		pthread_mutex_lock(&pool->lock);
+		block = pool->failed ? pool->numBlocks : pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+
+		if (block >= pool->numBlocks)
+		{
+			break;
+		}
+		if (BLOCKDecodeBlock(pool, block) == -1)
+		{
+			pthread_mutex_lock(&pool->lock);
+			pool->failed = 1;
+			pthread_mutex_unlock(&pool->lock);
+		}
+	}
+	TimerMerge();
+
+	return NULL;
+}
+
+
+/* follow the size prefixes through input, recording where the code of
+ * each block starts if offsets is not NULL; returns the number of blocks,
+ * or -1 if the stream is broken */
+static int BLOCKScan(const unsigned char *input, long long inputLength, long long *offsets)
+{
+	long long position, length;
+	int numBlocks;
+
+	for (position = 0, numBlocks = 0; position < inputLength; numBlocks++)
+	{
+		if (position + BLOCK_PREFIX_SIZE > inputLength)
+		{
+			printf("BLOCKScan(): block %d is cut off.\n", numBlocks);
+			return -1;
+		}
+		length = ((long long)input[position] << 24) | (input[position + 1] << 16)
+			| (input[position + 2] << 8) | input[position + 3];
+		if (offsets != NULL)
+		{
+			offsets[numBlocks] = position + BLOCK_PREFIX_SIZE;
+		}
+		position += BLOCK_PREFIX_SIZE + length;
+		if (position > inputLength)
+		{
+			printf("BLOCKScan(): block %d is cut off.\n", numBlocks);
+			return -1;
+		}
+	}
+
+	return numBlocks;
+}
+
+
+/* bytes BLOCKDecode may write: the length in the header, or as many full
+ * blocks as the stream holds when the header does not know; -1 if the
+ * stream is broken */
+long long BLOCKDecodeBound(const unsigned char *input, long long inputLength, const HUFFMANHEADER *header)
+{
+	int numBlocks;
+
+	if (header->length != HUFFMAN_LENGTH_UNKNOWN)
+	{
+		return header->length;
+	}
+	if (header->blockSize <= 0 || (numBlocks = BLOCKScan(input, inputLength, NULL)) == -1)
+	{
+		return -1;
+	}
+
+	return (long long)numBlocks * header->blockSize;
+}
+
+
+/* decode the block stream in input (everything after the file header) into
+ * output, which holds BLOCKDecodeBound() bytes, with up to threads threads
+ * (0 = one per processor); returns the bytes decoded, or -1 if the stream
+ * is broken */
+long long BLOCKDecode(const unsigned char *input, long long inputLength, const HUFFMANHEADER *header,
+	unsigned char *output, int threads)
+{
+	BLOCKPOOL pool;
+	pthread_t *workers;
+	long long *offsets;
+	int i, numBlocks, started;
+
+	if (header->blockSize <= 0)
+	{
+		printf("BLOCKDecode(): not a block stream.\n");
+		return -1;
+	}
+
+	if ((numBlocks = BLOCKScan(input, inputLength, NULL)) == -1)
+	{
+		return -1;
+	}
+	if (header->length != HUFFMAN_LENGTH_UNKNOWN
+		&& numBlocks != (header->length == 0 ? 0 : (header->length - 1) / header->blockSize + 1))
+	{
+		printf("BLOCKDecode(): %d blocks for %lld bytes.\n", numBlocks, header->length);
+		return -1;
+	}
+	if (numBlocks == 0)
+	{
+		return 0;
+	}
+
+	if ((offsets = (long long *) malloc (numBlocks * sizeof(long long))) == NULL)
+	{
+		printf("BLOCKDecode(): fail to allocate block index.\n");
+		return -1;
+	}
+	BLOCKScan(input, inputLength, offsets);
+
+	if (threads <= 0)
+	{
+		threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if (threads > numBlocks)
+	{
+		threads = numBlocks;
+	}
+	if (threads < 1)
+	{
+		threads = 1;
+	}
+
+	pool.header = header;
+	pool.engine = HuffmanEngine(header->engine);
+	pool.input = input;
+	pool.inputLength = inputLength;
+	pool.offsets = offsets;
+	pool.output = output;
+	pool.numBlocks = numBlocks;
+	pool.lastLength = -1;
+	if (header->length != HUFFMAN_LENGTH_UNKNOWN)
+	{
+		pool.lastLength = header->length - (long long)(numBlocks - 1) * header->blockSize;
+	}
+	pool.next = 0;
+	pool.failed = 0;
+	pthread_mutex_init(&pool.lock, NULL);
+
+	/* the calling thread is one of the workers */
+	started = 0;
+	workers = (pthread_t *) malloc ((threads - 1) * sizeof(pthread_t) + 1);
+	for (i = 0; workers != NULL && i < threads - 1; i++)
+	{
+		if (pthread_create(&workers[started], NULL, BLOCKDecodeWorker, &pool) == 0)
+		{
+			started++;
+		}
+	}
+	BLOCKDecodeWorker(&pool);
+	for (i = 0; i < started; i++)
+	{
+		pthread_join(workers[i], NULL);
+	}
+
+	free(workers);
+	free(offsets);
+	pthread_mutex_destroy(&pool.lock);
+
+	if (pool.failed)
+	{
+		return -1;
+	}
+
+	return (long long)(numBlocks - 1) * header->blockSize + pool.lastLength;
+}
@@ -0,0 +1,44 @@
+/*************************************************************************
+ *
+ *	File:	block.h
+ *	Author:  Jing Huang & Liang Wu
+ *
+ *	Description: block stream, the input cut into blocks of blockSize bytes,
+ *  each coded by a fresh coder so blocks can be decoded in parallel. Each
+ *  block is stored as its compressed size (4 bytes, big endian) followed
+ *  by its code, which ends in the end code of its engine; the block size
+ *  itself is in the file header.
+ *
+ ************************************************************************/
+
+#ifndef __BLOCK_H_
+#define __BLOCK_H_
+
+#include <stdio.h>
+#include "huffman.h"
+
+#define BLOCK_DEFAULT_SIZE   (1 << 20)
+#define BLOCK_PREFIX_SIZE    4
+
+typedef struct
+{
+	const HUFFMANENGINE *engine;
+	int weightLimit;
+	int blockSize;
+	unsigned char *input;	/* bytes of the block being filled */
+	int inputLength;
+	unsigned char *output;	/* code of one block */
+	FILE *stream;
+	long long BytesWrite;
+}BLOCKENCODER;
+
+BLOCKENCODER *BLOCKEncoderAlloc(FILE *stream, const HUFFMANENGINE *engine, int weightLimit, int blockSize);
+int BLOCKEncoderEncode(BLOCKENCODER *encoder, const unsigned char *data, int length);
+int BLOCKEncoderFlush(BLOCKENCODER *encoder);
+void BLOCKEncoderDealloc(BLOCKENCODER *encoder);
+long long BLOCKEncoderBytesWrite(BLOCKENCODER *encoder);
+long long BLOCKDecodeBound(const unsigned char *input, long long inputLength, const HUFFMANHEADER *header);
+long long BLOCKDecode(const unsigned char *input, long long inputLength, const HUFFMANHEADER *header,
+	unsigned char *output, int threads);
+
+#endif
@@ -0,0 +1,313 @@
+/*************************************************************************
+ *
+ *	File:	checkpoint.c
+ *	Author:  Jing Huang & Liang Wu
+ *
+ ************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "checkpoint.h"
+
+
+/* an index for the stream encoder writes */
+CHECKPOINTINDEX *CheckpointIndexAlloc(const HUFFMANENGINE *engine, void *encoder, long long interval)
+{
+	CHECKPOINTINDEX *index;
+
+	/* engines without snapshots cannot tell where they are either */
+	if (engine->EncoderBitsWrite(encoder) == -1)
+	{
+		printf("CheckpointIndexAlloc(): engine %s cannot take checkpoints.\n", engine->name);
+		return NULL;
+	}
+
+	if ((index = (CHECKPOINTINDEX *) malloc (sizeof(CHECKPOINTINDEX))) == NULL)
+	{
+		printf("CheckpointIndexAlloc(): fail to allocate index.\n");
+		return NULL;
+	}
+
+	index->engine = engine;
+	index->interval = (interval > 0) ? interval : CHECKPOINT_DEFAULT_INTERVAL;
+	index->numCheckpoints = 0;
+	index->capacity = 0;
+	index->checkpoints = NULL;
+
+	return index;
+}
+
+
+void CheckpointIndexDealloc(CHECKPOINTINDEX *index)
+{
+	int i;
+
+	if (index == NULL) return;
+	for (i = 0; i < index->numCheckpoints; i++)
+	{
+		free(index->checkpoints[i].state);
+	}
+	free(index->checkpoints);
+	free(index);
+}
+
+
+static int CheckpointIndexGrow(CHECKPOINTINDEX *index)
+{
+	CHECKPOINT *checkpoints;
+	int capacity;
+
+	capacity = (index->capacity > 0) ? index->capacity * 2 : 16;
+	if ((checkpoints = (CHECKPOINT *) realloc (index->checkpoints, capacity * sizeof(CHECKPOINT))) == NULL)
+	{
+		printf("CheckpointIndexGrow(): fail to grow index.\n");
+		return -1;
+	}
+	index->checkpoints = checkpoints;
+	index->capacity = capacity;
+
+	return 0;
+}
+
+
+/* called between symbols with the number coded so far, as often as the
+ * caller likes; takes a checkpoint once interval symbols have passed
+ * since the last one */
+int CheckpointIndexAdd(CHECKPOINTINDEX *index, void *encoder, long long symbols)
+{
+	CHECKPOINT *checkpoint;
+	CODERSTATE state;
+	unsigned char buffer[STATE_MAX_BYTES];
+	long long last;
+
+	last = (index->numCheckpoints > 0) ? index->checkpoints[index->numCheckpoints - 1].symbols : 0;
+	if (symbols - last < index->interval)
+	{
+		return 0;
+	}
+
+	if (index->numCheckpoints == index->capacity && CheckpointIndexGrow(index) == -1)
+	{
+		return -1;
+	}
+
+	checkpoint = &index->checkpoints[index->numCheckpoints];
+	checkpoint->symbols = symbols;
+	checkpoint->bits = index->engine->EncoderBitsWrite(encoder);
+	if (index->engine->CoderSaveState(encoder, &state) == -1)
+	{
+		return -1;
+	}
+	checkpoint->stateLength = StateWrite(&state, buffer);
+	if ((checkpoint->state = (unsigned char *) malloc (checkpoint->stateLength)) == NULL)
+	{
+		printf("CheckpointIndexAdd(): fail to allocate checkpoint.\n");
+		return -1;
+	}
+	memcpy(checkpoint->state, buffer, checkpoint->stateLength);
+	index->numCheckpoints++;
+
+	return 0;
+}
+
+
+/* make decoder, over a stream of length bytes, return symbol number symbol
+ * (counted from 0) next */
+int CheckpointSeek(CHECKPOINTINDEX *index, void *decoder, long long symbol, long long length)
+{
+	const HUFFMANENGINE *engine = index->engine;
+	CODERSTATE state;
+	long long i, symbols, bits;
+	int low, high, middle;
+
+	/* the last checkpoint at or before symbol */
+	low = 0;
+	high = index->numCheckpoints;
+	while (low < high)
+	{
+		middle = (low + high) / 2;
+		if (index->checkpoints[middle].symbols <= symbol)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	if (low > 0)
+	{
+		symbols = index->checkpoints[low - 1].symbols;
+		bits = index->checkpoints[low - 1].bits;
+		if (StateRead(&state, index->checkpoints[low - 1].state, index->checkpoints[low - 1].stateLength) == -1)
+		{
+			printf("CheckpointSeek(): checkpoint %d is corrupt.\n", low - 1);
+			return -1;
+		}
+	}
+	else
+	{
+		/* before the first checkpoint: start over from an empty tree */
+		symbols = 0;
+		bits = 0;
+		state.numNodes = 1;
+		for (i = 0; i < 8; i++)
+		{
+			state.symbolRecord[i] = 0;
+		}
+		state.nodes[0].symbol = -1;
+		state.nodes[0].weight = 0;
+		state.nodes[0].parent = 0;
+	}
+
+	if (engine->CoderLoadState(decoder, &state) == -1
+		|| engine->DecoderSeek(decoder, bits, length) == -1)
+	{
+		return -1;
+	}
+
+	for (i = symbols; i < symbol; i++)
+	{
+		engine->DecoderDecode(decoder);
+	}
+
+	return 0;
+}
+
+
+static void CheckpointPutNumber(unsigned char *bytes, long long value, int size)
+{
+	int i;
+
+	for (i = 0; i < size; i++)
+	{
+		bytes[i] = (unsigned char)(value >> (8 * (size - 1 - i)));
+	}
+}
+
+
+static long long CheckpointGetNumber(const unsigned char *bytes, int size)
+{
+	unsigned long long value = 0;
+	int i;
+
+	for (i = 0; i < size; i++)
+	{
+		value = (value << 8) | bytes[i];
+	}
+
+	return (long long)value;
+}
+
+
+/* the index file: magic, version, engine, interval (8 bytes) and the number
+ * of checkpoints (4), then for each its symbols (8), bits (8), the size of
+ * its state (2) and the state, all big endian */
+int CheckpointIndexWrite(FILE *stream, CHECKPOINTINDEX *index)
+{
+	unsigned char bytes[18];
+	CHECKPOINT *checkpoint;
+	int i;
+
+	bytes[0] = CHECKPOINT_MAGIC0;
+	bytes[1] = CHECKPOINT_MAGIC1;
+	bytes[2] = CHECKPOINT_VERSION;
+	bytes[3] = (unsigned char)index->engine->id;
+	CheckpointPutNumber(bytes + 4, index->interval, 8);
+	CheckpointPutNumber(bytes + 12, index->numCheckpoints, 4);
+	if (fwrite(bytes, 1, 16, stream) != 16)
+	{
+		printf("CheckpointIndexWrite(): fail to write index.\n");
+		return -1;
+	}
+
+	for (i = 0; i < index->numCheckpoints; i++)
+	{
+		checkpoint = &index->checkpoints[i];
+		CheckpointPutNumber(bytes, checkpoint->symbols, 8);
+		CheckpointPutNumber(bytes + 8, checkpoint->bits, 8);
+		CheckpointPutNumber(bytes + 16, checkpoint->stateLength, 2);
+		if (fwrite(bytes, 1, 18, stream) != 18
+			|| fwrite(checkpoint->state, 1, checkpoint->stateLength, stream) != (size_t)checkpoint->stateLength)
+		{
+			printf("CheckpointIndexWrite(): fail to write index.\n");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+CHECKPOINTINDEX *CheckpointIndexRead(FILE *stream)
+{
+	unsigned char bytes[18];
+	CHECKPOINTINDEX *index;
+	CHECKPOINT *checkpoint;
+	const HUFFMANENGINE *engine;
+	int i, count;
+
+	if (fread(bytes, 1, 16, stream) != 16
+		|| bytes[0] != CHECKPOINT_MAGIC0 || bytes[1] != CHECKPOINT_MAGIC1 || bytes[2] != CHECKPOINT_VERSION)
+	{
+		printf("CheckpointIndexRead(): not a checkpoint index of version %d.\n", CHECKPOINT_VERSION);
+		return NULL;
+	}
+	if ((engine = HuffmanEngine(bytes[3])) == NULL)
+	{
+		printf("CheckpointIndexRead(): unknown engine %d.\n", bytes[3]);
+		return NULL;
+	}
+
+	if ((index = (CHECKPOINTINDEX *) malloc (sizeof(CHECKPOINTINDEX))) == NULL)
+	{
+		printf("CheckpointIndexRead(): fail to allocate index.\n");
+		return NULL;
+	}
+	index->engine = engine;
+	index->interval = CheckpointGetNumber(bytes + 4, 8);
+	index->numCheckpoints = 0;
+	index->capacity = 0;
+	index->checkpoints = NULL;
+
+	count = (int)CheckpointGetNumber(bytes + 12, 4);
+	for (i = 0; i < count; i++)
+	{
+		if (index->numCheckpoints == index->capacity && CheckpointIndexGrow(index) == -1)
+		{
+			CheckpointIndexDealloc(index);
+			return NULL;
+		}
+		checkpoint = &index->checkpoints[i];
+		if (fread(bytes, 1, 18, stream) != 18)
+		{
+			printf("CheckpointIndexRead(): index ends early.\n");
+			CheckpointIndexDealloc(index);
+			return NULL;
+		}
+		checkpoint->symbols = CheckpointGetNumber(bytes, 8);
+		checkpoint->bits = CheckpointGetNumber(bytes + 8, 8);
+		checkpoint->stateLength = (int)CheckpointGetNumber(bytes + 16, 2);
+		/* seeking searches the checkpoints in order and starts at their bits */
+		if (checkpoint->symbols < 0 || checkpoint->bits < 0
+			|| (i > 0 && (checkpoint->symbols < checkpoint[-1].symbols || checkpoint->bits < checkpoint[-1].bits))
+			|| checkpoint->stateLength > STATE_MAX_BYTES
+			|| (checkpoint->state = (unsigned char *) malloc (checkpoint->stateLength + 1)) == NULL)
+		{
+			printf("CheckpointIndexRead(): bad checkpoint %d.\n", i);
+			CheckpointIndexDealloc(index);
+			return NULL;
+		}
+		/* counted now so a short read frees it with the rest */
+		index->numCheckpoints++;
+		if (fread(checkpoint->state, 1, checkpoint->stateLength, stream) != (size_t)checkpoint->stateLength)
+		{
+			printf("CheckpointIndexRead(): index ends early.\n");
+			CheckpointIndexDealloc(index);
+			return NULL;
+		}
+	}
+
+	return index;
+}
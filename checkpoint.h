@@ -0,0 +1,48 @@
+/*************************************************************************
+ *
+ *	File:	checkpoint.h
+ *	Author:  Jing Huang & Liang Wu
+ *
+ *	Description: random access into one adaptive stream. The encoder
+ *  takes a snapshot of its model every so many symbols; seeking loads
+ *  the nearest snapshot at or before the target into a decoder and
+ *  decodes forward from there. The index can be kept next to the stream
+ *  in a file of its own.
+ *
+ ************************************************************************/
+
+#ifndef __CHECKPOINT_H_
+#define __CHECKPOINT_H_
+
+#include "huffman.h"
+
+#define CHECKPOINT_DEFAULT_INTERVAL  (1 << 20)	/* symbols between checkpoints */
+#define CHECKPOINT_MAGIC0            'A'
+#define CHECKPOINT_MAGIC1            'C'
+#define CHECKPOINT_VERSION           1
+
+typedef struct
+{
+	long long symbols;	/* symbols coded before this point */
+	long long bits;	/* where the code of the next symbol starts */
+	int stateLength;
+	unsigned char *state;	/* the model, packed by StateWrite() */
+}CHECKPOINT;
+
+typedef struct
+{
+	const HUFFMANENGINE *engine;
+	long long interval;
+	int numCheckpoints;
+	int capacity;
+	CHECKPOINT *checkpoints;	/* in increasing symbols */
+}CHECKPOINTINDEX;
+
+CHECKPOINTINDEX *CheckpointIndexAlloc(const HUFFMANENGINE *engine, void *encoder, long long interval);
+void CheckpointIndexDealloc(CHECKPOINTINDEX *index);
+int CheckpointIndexAdd(CHECKPOINTINDEX *index, void *encoder, long long symbols);
+int CheckpointSeek(CHECKPOINTINDEX *index, void *decoder, long long symbol, long long length);
+int CheckpointIndexWrite(FILE *stream, CHECKPOINTINDEX *index);
+CHECKPOINTINDEX *CheckpointIndexRead(FILE *stream);
+
+#endif
@@ -11,12 +11,17 @@
  ************************************************************************/
 
 #include "fgk.h"
+#include "iochain.h"
 
-static int GetByte(void *stream, int *CurrentBytes, int IsFile)
+static int GetByte(void *stream, long long *CurrentBytes, int IsFile)
 {
 	int value;
 	
-	if (IsFile)
+	if (IsFile == IOCHAIN_STREAM)
+	{
+		value = IOChainGet((IOCHAIN *)stream);
+	}
+	else if (IsFile)
 	{
 		value = getc((FILE *)stream);
 	}
@@ -31,9 +36,13 @@ static int GetByte(void *stream, int *CurrentBytes, int IsFile)
 }
 
 
-static void PutByte(void *stream, int value, int *CurrentBytes, int IsFile)
+static void PutByte(void *stream, int value, long long *CurrentBytes, int IsFile)
 {
-	if (IsFile)
+	if (IsFile == IOCHAIN_STREAM)
+	{
+		IOChainPut((IOCHAIN *)stream, value);
+	}
+	else if (IsFile)
 	{
 		putc(value, (FILE *)stream);
 	}
@@ -146,6 +155,7 @@ static int FGKEncoderInit(FGKENCODER *encoder, void *stream, int IsFile)
 	int i;
 	encoder->IsFile = IsFile;	
 	encoder->OutBits = 0;
+	encoder->weightLimit = MAX_WEIGHT;
 	encoder->CurrentBytes = 0;
 	encoder->rack = 0;
 	encoder->mask = 0x80;
@@ -406,8 +416,9 @@ static bool isLeafNode(FGKTREENODE *node)
 	return false;
 }
 
-/* pre-order traverse to find the nodes with the same weight */
-static void findSameWeightNodes(FGKTREENODE *localRoot, FGKTREENODE *sameWeightNodes[256], int weight, int *count)
+/* pre-order traverse to find the nodes with the same weight; leaves and
+ * internal nodes alike, so up to the whole tree of 513 nodes */
+static void findSameWeightNodes(FGKTREENODE *localRoot, FGKTREENODE *sameWeightNodes[513], int weight, int *count)
 {
 	if (localRoot->weight == weight)
 	{
@@ -427,7 +438,7 @@ static void findSameWeightNodes(FGKTREENODE *localRoot, FGKTREENODE *sameWeightN
 static FGKTREENODE *findLowestNumberedLeaf(FGKTREE *tree, FGKTREENODE *node)
 {
 	FGKTREENODE *iter = NULL;
-	FGKTREENODE *sameWeightNodes[256];
+	FGKTREENODE *sameWeightNodes[513];
 	int weight = node->weight;
 	int i, count, number;
 	
@@ -450,7 +461,7 @@ static FGKTREENODE *findLowestNumberedLeaf(FGKTREE *tree, FGKTREENODE *node)
 static FGKTREENODE *findLowestNumberedNode(FGKTREE *tree, FGKTREENODE *node)
 {
 	FGKTREENODE *iter;
-	FGKTREENODE *sameWeightNodes[256];
+	FGKTREENODE *sameWeightNodes[513];
 	int weight = node->weight;
 	int i, count, number;
 	
@@ -470,6 +481,164 @@ static FGKTREENODE *findLowestNumberedNode(FGKTREE *tree, FGKTREENODE *node)
 	return iter;
 }
 
+/* pre-order traverse to index every tree node by its number */
+static void collectNodes(FGKTREENODE *localRoot, FGKTREENODE *nodeList[513])
+{
+	nodeList[localRoot->number - 1] = localRoot;
+	
+	if (localRoot->left != NULL)
+	{
+		collectNodes(localRoot->left, nodeList);
+	}
+	if (localRoot->right != NULL)
+	{
+		collectNodes(localRoot->right, nodeList);
+	}
+}
+
+/* halve the weight of every seen symbol (a seen symbol keeps at least 1) and 
+ * rebuild the tree in place from the same nodes: leaves are merged in order of
+ * increasing weight, internal nodes before leaves of equal weight, and numbered
+ * back from the root so the sibling property holds again. The zero node stays
+ * the highest numbered leaf. Encoder and decoder do this at the same symbol. */
+static void FGKTreeRescale(FGKCODER *coder)
+{
+	FGKTREENODE *nodeList[513], *leaves[257], *internals[256], *merged[256], *order[513];
+	FGKTREENODE *pair[2], *parent;
+	int numLeaves, numInternals, numMerged, i, j, k, m, count;
+
+	if (coder->tree->maxNumber < 3)
+	{
+		return;
+	}
+
+	collectNodes(coder->tree->root, nodeList);
+
+	/* nodes by number are in decreasing weight order, so walking them backwards
+	 * yields the leaves in increasing weight, which halving does not change */
+	numLeaves = 0;
+	numInternals = 0;
+	for (i = coder->tree->maxNumber - 1; i >= 0; i--)
+	{
+		if (isLeafNode(nodeList[i]))
+		{
+			nodeList[i]->weight = (nodeList[i]->weight + 1) / 2;
+			leaves[numLeaves++] = nodeList[i];
+		}
+		else
+		{
+			internals[numInternals++] = nodeList[i];
+		}
+	}
+
+	/* two-queue Huffman merge reusing the internal nodes; taking internal nodes
+	 * first on ties keeps the zero node's parent behind the leaves of its weight */
+	i = 0;
+	j = 0;
+	numMerged = 0;
+	count = 0;
+	for (m = 0; m < numInternals; m++)
+	{
+		for (k = 0; k < 2; k++)
+		{
+			if (j >= numMerged || (i < numLeaves && leaves[i]->weight < merged[j]->weight))
+			{
+				pair[k] = leaves[i++];
+			}
+			else
+			{
+				pair[k] = merged[j++];
+			}
+			order[count++] = pair[k];
+		}
+
+		parent = internals[m];
+		parent->weight = pair[0]->weight + pair[1]->weight;
+		parent->right = pair[0];
+		parent->left = pair[1];
+		pair[0]->parent = parent;
+		pair[0]->isLeft = false;
+		pair[1]->parent = parent;
+		pair[1]->isLeft = true;
+		merged[numMerged++] = parent;
+	}
+
+	parent = merged[numMerged - 1];
+	parent->parent = NULL;
+	parent->isLeft = false;
+	order[count++] = parent;
+	coder->tree->root = parent;
+
+	/* the last node merged is the root, number 1 */
+	for (i = 0; i < count; i++)
+	{
+		order[i]->number = count - i;
+	}
+}
+
+#ifdef HUFFMAN_DEBUG
+/* stop at the first broken invariant: every number up to maxNumber is used
+ * once, weights never increase with the number, siblings are adjacent,
+ * parents hold the sum of their children and the zero node is the last node */
+static void FGKTreeCheck(FGKCODER *coder)
+{
+	FGKTREENODE *nodeList[513], *node;
+	int i;
+
+	for (i = 0; i < coder->tree->maxNumber; i++)
+	{
+		nodeList[i] = NULL;
+	}
+	collectNodes(coder->tree->root, nodeList);
+
+	if (coder->tree->root->number != 1 || coder->tree->root->parent != NULL)
+	{
+		printf("FGKTreeCheck(): root is not node 1\n");
+		abort();
+	}
+	node = nodeList[coder->tree->maxNumber - 1];
+	if (node == NULL || !isLeafNode(node) || node->weight != 0)
+	{
+		printf("FGKTreeCheck(): zero node is not the last node\n");
+		abort();
+	}
+
+	for (i = 0; i < coder->tree->maxNumber; i++)
+	{
+		node = nodeList[i];
+		if (node == NULL || node->number != i + 1)
+		{
+			printf("FGKTreeCheck(): no node numbered %d\n", i + 1);
+			abort();
+		}
+		if (i > 0 && nodeList[i - 1]->weight < node->weight)
+		{
+			printf("FGKTreeCheck(): node %d outweighs node %d\n", i + 1, i);
+			abort();
+		}
+		if (isLeafNode(node))
+		{
+			continue;
+		}
+		if (node->left->number + 1 != node->right->number
+			|| node->left->weight + node->right->weight != node->weight)
+		{
+			printf("FGKTreeCheck(): children of node %d break the sibling property\n", i + 1);
+			abort();
+		}
+		if (node->left->parent != node || node->right->parent != node
+			|| !node->left->isLeft || node->right->isLeft)
+		{
+			printf("FGKTreeCheck(): children of node %d are linked wrong\n", i + 1);
+			abort();
+		}
+	}
+}
+#define FGK_CHECK(coder) FGKTreeCheck(coder)
+#else
+#define FGK_CHECK(coder)
+#endif
+
 static void FGKTreeUpdate(FGKCODER *coder, FGKTREENODE *node, int symbol)
 {
 	FGKTREENODE *parentOfZeroNode, *newZeroNode, *iter, *lowestNumberLeaf, *lowestNumberNode, *tempNode;
@@ -483,7 +652,7 @@ static void FGKTreeUpdate(FGKCODER *coder, FGKTREENODE *node, int symbol)
 		/* update the record of which symbol has existed */
 		i = symbol / NUM_BITS_IN_INT;
 		j = symbol % NUM_BITS_IN_INT;		
-		coder->symbolRecord[i] |=  (1 << j);		
+		coder->symbolRecord[i] |=  (1U << j);		
 				
 		/* replace iter by a parent 0-node with two leaf 0-node children, 
 		 * and numbered in the order parent, left child, and right child (different from algorithm description),
@@ -610,6 +779,11 @@ static void FGKTreeUpdate(FGKCODER *coder, FGKTREENODE *node, int symbol)
 		iter->weight++;
 	}
 	
+	if (coder->tree->root->weight >= coder->weightLimit)
+	{
+		FGKTreeRescale(coder);
+	}
+	FGK_CHECK(coder);
 }
 
 void FGKEncoderEncode(FGKENCODER *encoder, int symbol)
@@ -621,6 +795,21 @@ void FGKEncoderEncode(FGKENCODER *encoder, int symbol)
 	//PrintFGKTree(encoder->tree->root);
 }
 
+/* end of the stream: the zero node code followed by a symbol already seen,
+ * which no real escape can carry. A stream without symbols needs none */
+void FGKEncoderEnd(FGKENCODER *encoder)
+{
+	int symbol;
+
+	for (symbol = 0; symbol < 256 && !isExisted(encoder, symbol); symbol++)
+	{
+	}
+	if (symbol < 256)
+	{
+		OutputZeroNodeCode(encoder, findZeroNode(encoder->tree->root), symbol);
+	}
+}
+
 /* post-order traverse and delete tree nodes */
 static void FGKTreeNodesDealloc(FGKTREENODE *localRoot)  
 {
@@ -644,7 +833,7 @@ void FGKEncoderDealloc(FGKENCODER *encoder)
 	free(encoder);
 }
 
-int FGKEncoderBytesWrite(FGKENCODER *encoder)
+long long FGKEncoderBytesWrite(FGKENCODER *encoder)
 {
 	return encoder->CurrentBytes;
 }
@@ -654,11 +843,11 @@ static int FGKDecoderInit(FGKDECODER *decoder, void *stream, int IsFile)
 	int i;
 	decoder->IsFile = IsFile;	
 	decoder->OutBits = 0;
+	decoder->weightLimit = MAX_WEIGHT;
 	decoder->CurrentBytes = 0;
 	decoder->rack = 0;
 	decoder->mask = 0x80;
 	decoder->stream = stream;
-	decoder->hasBit = false;
 	
 	for (i = 0; i < 8; i++)
 	{
@@ -700,66 +889,25 @@ FGKDECODER *FGKDecoderAlloc(void *stream, int IsFile)
 	return decoder;
 }
 
-static FGKTREENODE *isFeasible(int bit, FGKTREENODE *node)
-{
-	FGKTREENODE *iter = NULL;
-	
-	if (bit == 0)
-	{
-		if (node->left != NULL)
-		{
-			iter = node->left;			
-		}
-	}
-	else
-	{
-		if (node->right != NULL)
-		{
-			iter = node->right;
-		}		
-	}
-	return iter;
-}
-
 static FGKTREENODE *FGKDecoderOutputSymbol(FGKDECODER *decoder, int *symbol)
 {
-	int bit, i;
-	FGKTREENODE *node, *iter;
-	iter = decoder->tree->root;
+	int i;
+	FGKTREENODE *node;
+	node = decoder->tree->root;
 	
-	/* read in first bit of child of root*/
-	if (decoder->hasBit)
-	{
-		bit = decoder->bit;
-	}
-	else
+	/* internal nodes always have both children, so the walk stops on the
+	   leaf and reads exactly its code */
+	while (node->left != NULL)
 	{
-		bit = GetBit(decoder);	
+		node = GetBit(decoder) ? node->right : node->left;
 	}
- 
-	while ((node = isFeasible(bit, iter)) != NULL)
-	{
-		bit = GetBit(decoder);
-		iter = node;
-	}
-	
-	/* need to store the last bit since this is used to decode the next symbol or read in new symbol*/
-	decoder->bit = bit;
-	decoder->hasBit = true;
-	
-	node = iter;
 	
 	if (node->weight == 0)  // zero node
 	{
 		/* read the new symbol */
-		bit = decoder->bit;
-		decoder->hasBit = false;
-		*symbol |= bit;		
-		for (i = 0; i < 7; i++)
+		for (i = 0; i < 8; i++)
 		{
-			*symbol <<= 1;
-			bit = GetBit(decoder);
-			*symbol |= bit;
+			*symbol = (*symbol << 1) | GetBit(decoder);
 		}
 	}
 	else
@@ -778,6 +926,11 @@ int FGKDecoderDecode(FGKDECODER *decoder)
 	//printf("\n");
 	//printf("symbol = %d\n", symbol);
 	
+	if (node->weight == 0 && isExisted(decoder, symbol))
+	{
+		return FGK_END;
+	}
+	
 	FGKTreeUpdate(decoder, node, symbol);	
 	//PrintFGKTree(decoder->tree->root);
 	
@@ -791,7 +944,21 @@ void FGKDecoderDealloc(FGKDECODER *decoder)
 	free(decoder);
 }
 
-int FGKDecoderBytesRead(FGKDECODER *decoder)
+long long FGKDecoderBytesRead(FGKDECODER *decoder)
 {
 	return decoder->CurrentBytes;
+}
+
+void FGKCoderSetWeightLimit(FGKCODER *coder, int weightLimit)
+{
+	if (weightLimit > 0 && weightLimit < MIN_WEIGHT_LIMIT)
+	{
+		weightLimit = MIN_WEIGHT_LIMIT;
+	}
+	/* 0 means no periodic halving, only the overflow guard */
+	if (weightLimit <= 0 || weightLimit > MAX_WEIGHT)
+	{
+		weightLimit = MAX_WEIGHT;
+	}
+	coder->weightLimit = weightLimit;
 }
\ No newline at end of file
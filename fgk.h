@@ -12,8 +12,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include "weight.h"
 
 #define NUM_BITS_IN_INT      32
+#define FGK_END              256	/* decoded the end of the stream */
 
 typedef struct FGKNode
 {
@@ -33,11 +35,11 @@ typedef struct
 typedef struct 
 {
 	int IsFile;	
-    int rack, value, CurrentBytes;
+    int rack, value;
+	long long CurrentBytes;
 	int InBits, OutBits;
 	int symbolRecord[8];
-	int bit;
-	bool hasBit;
+	int weightLimit;	/* root weight at which all weights are halved */
 	unsigned char mask;
 	void *stream;
 	FGKTREE *tree;
@@ -49,11 +51,13 @@ typedef struct
 void FGKEncoderFlush(FGKENCODER *encoder);
 FGKENCODER *FGKEncoderAlloc(void *stream, int IsFile);
 void FGKEncoderEncode(FGKENCODER *encoder, int symbol);
+void FGKEncoderEnd(FGKENCODER *encoder);
 void FGKEncoderDealloc(FGKENCODER *encoder);
-int FGKEncoderBytesWrite(FGKDECODER *encoder);
-FGKDECODER *FGKDEcoderAlloc(void *stream, int IsFile);
+long long FGKEncoderBytesWrite(FGKDECODER *encoder);
+FGKDECODER *FGKDecoderAlloc(void *stream, int IsFile);
 int FGKDecoderDecode(FGKDECODER *decoder);
 void FGKDecoderDealloc(FGKDECODER *decoder);
-int FGKDecoderBytesRead(FGKDECODER *decoder);
+long long FGKDecoderBytesRead(FGKDECODER *decoder);
+void FGKCoderSetWeightLimit(FGKCODER *coder, int weightLimit);
 
 #endif
\ No newline at end of file
@@ -10,13 +10,22 @@
  *
  ************************************************************************/
 
-#include "FGKFAST.h"
+#include <string.h>
+#include "fgkFast.h"
+#include "timer.h"
+#include "prefetch.h"
+#include "scan.h"
+#include "iochain.h"
 
-static int GetByte(void *stream, int *CurrentBytes, int IsFile)
+static int GetByte(void *stream, long long *CurrentBytes, int IsFile)
 {
 	int value;
 	
-	if (IsFile)
+	if (IsFile == IOCHAIN_STREAM)
+	{
+		value = IOChainGet((IOCHAIN *)stream);
+	}
+	else if (IsFile)
 	{
 		value = getc((FILE *)stream);
 	}
@@ -31,9 +40,13 @@ static int GetByte(void *stream, int *CurrentBytes, int IsFile)
 }
 
 
-static void PutByte(void *stream, int value, int *CurrentBytes, int IsFile)
+static void PutByte(void *stream, int value, long long *CurrentBytes, int IsFile)
 {
-	if (IsFile)
+	if (IsFile == IOCHAIN_STREAM)
+	{
+		IOChainPut((IOCHAIN *)stream, value);
+	}
+	else if (IsFile)
 	{
 		putc(value, (FILE *)stream);
 	}
@@ -49,6 +62,9 @@ static int GetBit(FGKFASTDECODER *decoder)
 {
 	int value;
 	
+	STATS_ADD(decoder, codeBits, 1);
+	decoder = decoder->io;
+	
 	if (decoder->mask == 0x80)
 	{
         decoder->rack = GetByte(decoder->stream, &(decoder->CurrentBytes), decoder->IsFile);
@@ -68,6 +84,9 @@ static int GetBit(FGKFASTDECODER *decoder)
 
 static void PutBit(FGKFASTENCODER *encoder, int bit)
 {
+	STATS_ADD(encoder, codeBits, 1);
+	encoder = encoder->io;
+	
 	if (bit)
 	{
 		encoder->rack |= encoder->mask;
@@ -96,21 +115,76 @@ static void PrintFGKFASTTree(FGKFASTTREENODE *localRoot)
 {
 	printf("number = %d, weight = %d, symbol = %d\n", localRoot->number, localRoot->weight, localRoot->symbol);
 	
-	if (localRoot->left != NULL)
+	if (localRoot->child[0] != NULL)
 	{
-		PrintFGKFASTTree(localRoot->left);
+		PrintFGKFASTTree(localRoot->child[0]);
 	}
-	if (localRoot->right != NULL)
+	if (localRoot->child[1] != NULL)
 	{
-		PrintFGKFASTTree(localRoot->right);
+		PrintFGKFASTTree(localRoot->child[1]);
 	}
 	
 }
 
+FGKFASTARENA *FGKFASTArenaAlloc(void)
+{
+	FGKFASTARENA *arena;
+	
+	if ((arena = (FGKFASTARENA *) malloc (sizeof(FGKFASTARENA))) == NULL)
+	{
+		printf("FGKFASTArenaAlloc(): fail to allocate node arena!\n");
+		return NULL;
+	}
+	arena->chunk = NULL;
+	arena->used = FGKFAST_ARENA_CHUNK;
+	
+	return arena;
+}
+
+void FGKFASTArenaDealloc(FGKFASTARENA *arena)
+{
+	FGKFASTARENACHUNK *chunk, *next;
+	
+	if (arena == NULL) return;
+	for (chunk = arena->chunk; chunk != NULL; chunk = next)
+	{
+		next = chunk->next;
+		free(chunk);
+	}
+	free(arena);
+}
+
+static FGKFASTTREENODE *FGKFASTArenaNode(FGKFASTARENA *arena)
+{
+	FGKFASTARENACHUNK *chunk;
+	
+	if (arena->used == FGKFAST_ARENA_CHUNK)
+	{
+		if ((chunk = (FGKFASTARENACHUNK *) malloc (sizeof(FGKFASTARENACHUNK))) == NULL)
+		{
+			return NULL;
+		}
+		chunk->next = arena->chunk;
+		arena->chunk = chunk;
+		arena->used = 0;
+	}
+	
+	return &arena->chunk->nodes[arena->used++];
+}
+
 static FGKFASTTREENODE *FGKFASTTreeNodeInit(FGKFASTCODER *coder)
 {	
 	FGKFASTTREENODE *node;
-	if ((node = (FGKFASTTREENODE *) malloc (sizeof(FGKFASTTREENODE))) == NULL)
+	
+	if (coder->arena != NULL)
+	{
+		node = FGKFASTArenaNode(coder->arena);
+	}
+	else
+	{
+		node = (FGKFASTTREENODE *) malloc (sizeof(FGKFASTTREENODE));
+	}
+	if (node == NULL)
 	{
 		printf("FGKFASTTreeNodeInit(): fail to allocate new node!");
 		return NULL;
@@ -119,12 +193,13 @@ static FGKFASTTREENODE *FGKFASTTreeNodeInit(FGKFASTCODER *coder)
 	node->symbol = -1;
 	node->weight = 0;
 	node->number = coder->tree->maxNumber + 1;
-	node->isLeft = false;
+	node->side = 1;
 	node->parent = NULL;
-	node->left = NULL;
-	node->right = NULL;
+	node->child[0] = NULL;
+	node->child[1] = NULL;
 	
 	coder->nodeList[coder->tree->maxNumber] = node;
+	coder->keys[coder->tree->maxNumber] = 0;
 	coder->tree->zeroNode = node;
 	coder->tree->maxNumber++;
 	
@@ -148,10 +223,16 @@ static int FGKFASTEncoderInit(FGKFASTENCODER *encoder, void *stream, int IsFile)
 	int i;
 	encoder->IsFile = IsFile;	
 	encoder->OutBits = 0;
+	encoder->weightLimit = MAX_WEIGHT;
+	memset(&encoder->stats, 0, sizeof(HUFFMANSTATS));
 	encoder->CurrentBytes = 0;
 	encoder->rack = 0;
 	encoder->mask = 0x80;
 	encoder->stream = stream;
+	encoder->rawSymbols = true;
+	encoder->io = encoder;
+	encoder->arena = NULL;
+	encoder->hotLimit = 0;
 	
 	for (i = 0; i < 8; i++)
 	{
@@ -208,8 +289,8 @@ static FGKFASTTREENODE *findZeroNode(FGKFASTTREENODE *localRoot)
 	}
 	else if (localRoot != NULL && localRoot->weight != 0)
 	{
-		node1 = findZeroNode(localRoot->left);
-		node2 = findZeroNode(localRoot->right);
+		node1 = findZeroNode(localRoot->child[0]);
+		node2 = findZeroNode(localRoot->child[1]);
 		if (node1 != NULL)
 		{
 			return node1;
@@ -240,14 +321,7 @@ static void OutputNodeCode(FGKFASTENCODER *encoder, FGKFASTTREENODE *node)
        and record each bit along the way in reversedOutputBits arrays */
 	while (iter != encoder->tree->root)
 	{
-		if (iter->isLeft)
-		{
-			reversedOutputBits[depth++] = 0;	
-		}
-		else
-		{
-			reversedOutputBits[depth++] = 1;
-		}
+		reversedOutputBits[depth++] = iter->side;
 		iter = iter->parent;
 	}
 	
@@ -259,6 +333,7 @@ static void OutputNodeCode(FGKFASTENCODER *encoder, FGKFASTTREENODE *node)
 		bit = reversedOutputBits[i];
 		PutBit(encoder, bit);
 	}
+	STATS_MAX(encoder, maxDepth, depth);
 }
 
 static void OutputZeroNodeCode(FGKFASTENCODER *encoder, FGKFASTTREENODE *zeroNode, int symbol)
@@ -266,6 +341,12 @@ static void OutputZeroNodeCode(FGKFASTENCODER *encoder, FGKFASTTREENODE *zeroNod
 	int i, bit;
 	
 	OutputNodeCode(encoder, zeroNode);
+	STATS_ADD(encoder, escapes, 1);
+	
+	if (!encoder->rawSymbols)
+	{
+		return;
+	}
 	
 	/* specify which symbol it is */	
 	for (i = 7; i >= 0; i--)
@@ -351,14 +432,7 @@ static bool isZeroNodeSibling(FGKFASTTREENODE *node)
 	FGKFASTTREENODE *sibling;
 	if (node->parent != NULL)
 	{
-		if (node->isLeft == true)
-		{
-			sibling = node->parent->right;
-		}
-		else
-		{
-			sibling = node->parent->left;
-		}
+		sibling = node->parent->child[node->side ^ 1];
 		if (sibling->weight == 0)
 		{
 			return true;
@@ -369,7 +443,7 @@ static bool isZeroNodeSibling(FGKFASTTREENODE *node)
 
 static bool isLeafNode(FGKFASTTREENODE *node)
 {
-	if (node->left == NULL)
+	if (node->child[0] == NULL)
 	{
 		return true;
 	}
@@ -384,13 +458,13 @@ static void findSameWeightNodes(FGKFASTTREENODE *localRoot, FGKFASTTREENODE *sam
 		sameWeightNodes[*count] = localRoot;
 		*count += 1;
 	}
-	if (localRoot->left != NULL)
+	if (localRoot->child[0] != NULL)
 	{
-		findSameWeightNodes(localRoot->left, sameWeightNodes, weight, count);
+		findSameWeightNodes(localRoot->child[0], sameWeightNodes, weight, count);
 	}
-	if (localRoot->right != NULL)
+	if (localRoot->child[1] != NULL)
 	{
-		findSameWeightNodes(localRoot->right, sameWeightNodes, weight, count);
+		findSameWeightNodes(localRoot->child[1], sameWeightNodes, weight, count);
 	}
 }
 
@@ -399,40 +473,260 @@ static FGKFASTTREENODE *findLowestNumberedLeaf(FGKFASTCODER *coder, FGKFASTTREEN
 	FGKFASTTREENODE *iter = node;
 	int i;
 	
-	i = node->number - 2;
-	while (coder->nodeList[i]->weight == node->weight)
+	for (i = ScanRunStart(coder->keys, node->number - 2, node->weight); i < node->number - 1; i++)
 	{
 		if (isLeafNode(coder->nodeList[i]))
 		{
 			iter = coder->nodeList[i];
+			break;
 		}
-		i--;
 	}
 	
+	STATS_ADD(coder, leaderSearches, 1);
+	STATS_ADD(coder, leaderDistance, node->number - iter->number);
+	
 	return iter;
 }
 	
 
+/* start loading what the next step up from node reads: its parent and the
+ * node numbered just below, where the search for its block leader begins */
+static void prefetchStep(FGKFASTCODER *coder, FGKFASTTREENODE *node)
+{
+	HUFFMAN_PREFETCH(node->parent);
+	if (node->number > 1)
+	{
+		HUFFMAN_PREFETCH(coder->nodeList[node->number - 2]);
+	}
+}
+
+#ifdef HUFFMAN_HOT_TOP
+/* nodes move among the numbers from number on; hotTop only holds numbers up
+ * to hotLimit, so it is still right unless number is within them */
+static void hotTopTouch(FGKFASTCODER *coder, int number)
+{
+	if (number <= coder->hotLimit)
+	{
+		coder->hotLimit = 0;
+	}
+}
+
+/* keep the top FGKFAST_HOT_LEVELS levels of the tree in hotTop, the
+ * children of position i at 2i+1 and 2i+2, and their shape in hotLeaves, so
+ * the first steps of a decode walk need no load at all */
+static void hotTopBuild(FGKFASTCODER *coder)
+{
+	FGKFASTTREENODE *node;
+	int i;
+
+	coder->hotTop[0] = coder->tree->root;
+	coder->hotLeaves = 0;
+	coder->hotLimit = 0;
+	for (i = 0; i < FGKFAST_HOT_SIZE; i++)
+	{
+		node = coder->hotTop[i];
+		if (i < (1 << FGKFAST_HOT_LEVELS) - 1)
+		{
+			coder->hotTop[2 * i + 1] = (node == NULL || isLeafNode(node)) ? NULL : node->child[0];
+			coder->hotTop[2 * i + 2] = (node == NULL || isLeafNode(node)) ? NULL : node->child[1];
+		}
+		if (node == NULL)
+		{
+			continue;
+		}
+		if (isLeafNode(node))
+		{
+			coder->hotLeaves |= 1u << i;
+		}
+		if (node->number > coder->hotLimit)
+		{
+			coder->hotLimit = node->number;
+		}
+	}
+}
+#else
+#define hotTopTouch(coder, number)
+#endif
+
 static FGKFASTTREENODE *findLowestNumberedNode(FGKFASTCODER *coder, FGKFASTTREENODE *node)
 {
 	FGKFASTTREENODE *iter = node;
 	int i;
 	
-	i = node->number - 2;
-	while (coder->nodeList[i]->weight == node->weight)
+	i = ScanRunStart(coder->keys, node->number - 2, node->weight);
+	if (i < node->number - 1)
 	{
 		iter = coder->nodeList[i];
-		i--;
 	}
 	
+	STATS_ADD(coder, leaderSearches, 1);
+	STATS_ADD(coder, leaderDistance, node->number - iter->number);
+	
 	return iter;
 }
 
+/* rebuild the tree in place from the same nodes, first halving the weight of
+ * every seen symbol (a seen symbol keeps at least 1) if asked: leaves are
+ * merged in order of increasing weight, internal nodes before leaves of
+ * equal weight, and numbered back from the root so the sibling property holds
+ * again. The zero node stays the highest numbered leaf. Encoder and decoder
+ * do this at the same symbol. */
+static void FGKFASTTreeRebuild(FGKFASTCODER *coder, bool halve)
+{
+	FGKFASTTREENODE *leaves[257], *internals[256], *merged[256], *order[513];
+	FGKFASTTREENODE *pair[2], *parent;
+	int numLeaves, numInternals, numMerged, i, j, k, m, count;
+
+	if (coder->tree->maxNumber < 3)
+	{
+		return;
+	}
+
+	/* nodeList is in decreasing weight order, so walking it backwards yields
+	 * the leaves in increasing weight, which halving does not change; a leaf
+	 * raised by a bulk update is moved back into place */
+	numLeaves = 0;
+	numInternals = 0;
+	for (i = coder->tree->maxNumber - 1; i >= 0; i--)
+	{
+		if (isLeafNode(coder->nodeList[i]))
+		{
+			parent = coder->nodeList[i];
+			if (halve)
+			{
+				parent->weight = (parent->weight + 1) / 2;
+			}
+			for (j = numLeaves; j > 0 && leaves[j - 1]->weight > parent->weight; j--)
+			{
+				leaves[j] = leaves[j - 1];
+			}
+			leaves[j] = parent;
+			numLeaves++;
+		}
+		else
+		{
+			internals[numInternals++] = coder->nodeList[i];
+		}
+	}
+
+	/* two-queue Huffman merge reusing the internal nodes; taking internal nodes
+	 * first on ties keeps the zero node's parent behind the leaves of its weight */
+	i = 0;
+	j = 0;
+	numMerged = 0;
+	count = 0;
+	for (m = 0; m < numInternals; m++)
+	{
+		for (k = 0; k < 2; k++)
+		{
+			if (j >= numMerged || (i < numLeaves && leaves[i]->weight < merged[j]->weight))
+			{
+				pair[k] = leaves[i++];
+			}
+			else
+			{
+				pair[k] = merged[j++];
+			}
+			order[count++] = pair[k];
+		}
+
+		parent = internals[m];
+		parent->weight = pair[0]->weight + pair[1]->weight;
+		parent->child[1] = pair[0];
+		parent->child[0] = pair[1];
+		pair[0]->parent = parent;
+		pair[0]->side = 1;
+		pair[1]->parent = parent;
+		pair[1]->side = 0;
+		merged[numMerged++] = parent;
+	}
+
+	parent = merged[numMerged - 1];
+	parent->parent = NULL;
+	parent->side = 1;
+	order[count++] = parent;
+	coder->tree->root = parent;
+	coder->hotLimit = 0;
+
+	/* the last node merged is the root, number 1 */
+	for (i = 0; i < count; i++)
+	{
+		order[i]->number = count - i;
+		coder->nodeList[count - i - 1] = order[i];
+		coder->keys[count - i - 1] = order[i]->weight;
+	}
+}
+
+static void FGKFASTTreeRescale(FGKFASTCODER *coder)
+{
+	FGKFASTTreeRebuild(coder, true);
+}
+
+#ifdef HUFFMAN_DEBUG
+/* stop at the first broken invariant: numbering matches nodeList, weights
+ * never increase with the number, siblings are adjacent, parents hold the
+ * sum of their children and the zero node is the last node */
+static void FGKFASTTreeCheck(FGKFASTCODER *coder)
+{
+	FGKFASTTREENODE *node;
+	int i;
+
+	if (coder->tree->root != coder->nodeList[0] || coder->tree->root->parent != NULL)
+	{
+		printf("FGKFASTTreeCheck(): root is not node 1\n");
+		abort();
+	}
+	if (coder->tree->zeroNode->weight != 0 || coder->tree->zeroNode->number != coder->tree->maxNumber)
+	{
+		printf("FGKFASTTreeCheck(): zero node is not the last node\n");
+		abort();
+	}
+
+	for (i = 0; i < coder->tree->maxNumber; i++)
+	{
+		node = coder->nodeList[i];
+		if (node->number != i + 1)
+		{
+			printf("FGKFASTTreeCheck(): node %d is numbered %d\n", i + 1, node->number);
+			abort();
+		}
+		if (i > 0 && coder->nodeList[i - 1]->weight < node->weight)
+		{
+			printf("FGKFASTTreeCheck(): node %d outweighs node %d\n", i + 1, i);
+			abort();
+		}
+		if (coder->keys[i] != (unsigned int)node->weight)
+		{
+			printf("FGKFASTTreeCheck(): key of node %d is stale\n", i + 1);
+			abort();
+		}
+		if (isLeafNode(node))
+		{
+			continue;
+		}
+		if (node->child[0]->number + 1 != node->child[1]->number
+			|| node->child[0]->weight + node->child[1]->weight != node->weight)
+		{
+			printf("FGKFASTTreeCheck(): children of node %d break the sibling property\n", i + 1);
+			abort();
+		}
+		if (node->child[0]->parent != node || node->child[1]->parent != node
+			|| node->child[0]->side != 0 || node->child[1]->side != 1)
+		{
+			printf("FGKFASTTreeCheck(): children of node %d are linked wrong\n", i + 1);
+			abort();
+		}
+	}
+}
+#define FGKFAST_CHECK(coder) FGKFASTTreeCheck(coder)
+#else
+#define FGKFAST_CHECK(coder)
+#endif
+
 static void FGKFASTTreeUpdate(FGKFASTCODER *coder, FGKFASTTREENODE *node, int symbol)
 {
 	FGKFASTTREENODE *parentOfZeroNode, *newZeroNode, *iter, *lowestNumberLeaf, *lowestNumberNode, *tempNode;
-	int tempNumber, i, j;
-	bool tempIsLeft;
+	int tempNumber, tempSide, i, j;
 	iter = node;
 	
 	/* if iter is zero node */
@@ -441,7 +735,8 @@ static void FGKFASTTreeUpdate(FGKFASTCODER *coder, FGKFASTTREENODE *node, int sy
 		/* update the record of which symbol has existed */
 		i = symbol / NUM_BITS_IN_INT;
 		j = symbol % NUM_BITS_IN_INT;		
-		coder->symbolRecord[i] |=  (1 << j);		
+		coder->symbolRecord[i] |=  (1U << j);		
+		hotTopTouch(coder, iter->number);
 				
 		/* replace iter by a parent 0-node with two leaf 0-node children, 
 		 * and numbered in the order parent, left child, and right child (different from algorithm description),
@@ -453,11 +748,10 @@ static void FGKFASTTreeUpdate(FGKFASTCODER *coder, FGKFASTTREENODE *node, int sy
 		
 		if (iter->parent != NULL)
 		{
-			if (iter->isLeft) iter->parent->left = parentOfZeroNode;
-			else iter->parent->right = parentOfZeroNode;
+			iter->parent->child[iter->side] = parentOfZeroNode;
 		}		
-		parentOfZeroNode->left = iter;
-		parentOfZeroNode->right = newZeroNode;
+		parentOfZeroNode->child[0] = iter;
+		parentOfZeroNode->child[1] = newZeroNode;
 		iter->parent = parentOfZeroNode;
 		newZeroNode->parent = parentOfZeroNode;
 		
@@ -468,7 +762,7 @@ static void FGKFASTTreeUpdate(FGKFASTCODER *coder, FGKFASTTREENODE *node, int sy
 		tempNumber = parentOfZeroNode->number;
 		parentOfZeroNode->number = iter->number;
 		iter->number = tempNumber; 
-		iter->isLeft = true;
+		iter->side = 0;
 		iter->symbol = symbol;
 						
 		/* if first symbol, then set root node as the parentOfZeroNode */
@@ -485,26 +779,14 @@ static void FGKFASTTreeUpdate(FGKFASTCODER *coder, FGKFASTTREENODE *node, int sy
 		lowestNumberLeaf = findLowestNumberedLeaf(coder, iter);
 		if (iter != lowestNumberLeaf)
 		{
+			STATS_ADD(coder, swaps, 1);
+			hotTopTouch(coder, lowestNumberLeaf->number);
 			/* replace this leaf with iter */
-			if (lowestNumberLeaf->isLeft)
-			{
-				lowestNumberLeaf->parent->left = iter;
-			}
-			else
-			{
-				lowestNumberLeaf->parent->right = iter;
-			}
-			if (iter->isLeft)
-			{
-				iter->parent->left = lowestNumberLeaf;
-			}
-			else
-			{
-				iter->parent->right = lowestNumberLeaf;
-			}
-			tempIsLeft = iter->isLeft;
-			iter->isLeft = lowestNumberLeaf->isLeft;
-			lowestNumberLeaf->isLeft = tempIsLeft;
+			lowestNumberLeaf->parent->child[lowestNumberLeaf->side] = iter;
+			iter->parent->child[iter->side] = lowestNumberLeaf;
+			tempSide = iter->side;
+			iter->side = lowestNumberLeaf->side;
+			lowestNumberLeaf->side = tempSide;
 			
 			tempNode = iter->parent;
 			iter->parent = lowestNumberLeaf->parent;
@@ -522,6 +804,7 @@ static void FGKFASTTreeUpdate(FGKFASTCODER *coder, FGKFASTTREENODE *node, int sy
 		
 		/* increment iter's weight by 1 */
 		iter->weight++;
+		coder->keys[iter->number - 1]++;
 		
 		/* iter = iter's parent */
 		iter = iter->parent;				
@@ -533,42 +816,37 @@ static void FGKFASTTreeUpdate(FGKFASTCODER *coder, FGKFASTTREENODE *node, int sy
 	{
 		/* find the lowest numbered node of the same weight */
 		lowestNumberNode = findLowestNumberedNode(coder, iter);
+		STATS_ADD(coder, swaps, lowestNumberNode != iter);
+		if (lowestNumberNode != iter)
+		{
+			hotTopTouch(coder, lowestNumberNode->number);
+		}
+		
+		/* iter moves under this parent, which is the next step */
+		prefetchStep(coder, lowestNumberNode->parent);
 		
 		/* replace this node with iter */
-		if (lowestNumberNode->isLeft)
-			{
-				lowestNumberNode->parent->left = iter;
-			}
-			else
-			{
-				lowestNumberNode->parent->right = iter;
-			}
-			if (iter->isLeft)
-			{
-				iter->parent->left = lowestNumberNode;
-			}
-			else
-			{
-				iter->parent->right = lowestNumberNode;
-			}
-			tempIsLeft = iter->isLeft;
-			iter->isLeft = lowestNumberNode->isLeft;
-			lowestNumberNode->isLeft = tempIsLeft;
-			
-			tempNode = iter->parent;
-			iter->parent = lowestNumberNode->parent;
-			lowestNumberNode->parent = tempNode;
-			
-			tempNode = coder->nodeList[iter->number - 1];
-			coder->nodeList[iter->number - 1] = coder->nodeList[lowestNumberNode->number - 1];
-			coder->nodeList[lowestNumberNode->number - 1] = tempNode;
-					
-			tempNumber = iter->number;
-			iter->number = lowestNumberNode->number;
-			lowestNumberNode->number = tempNumber;
+		lowestNumberNode->parent->child[lowestNumberNode->side] = iter;
+		iter->parent->child[iter->side] = lowestNumberNode;
+		tempSide = iter->side;
+		iter->side = lowestNumberNode->side;
+		lowestNumberNode->side = tempSide;
+		
+		tempNode = iter->parent;
+		iter->parent = lowestNumberNode->parent;
+		lowestNumberNode->parent = tempNode;
+		
+		tempNode = coder->nodeList[iter->number - 1];
+		coder->nodeList[iter->number - 1] = coder->nodeList[lowestNumberNode->number - 1];
+		coder->nodeList[lowestNumberNode->number - 1] = tempNode;
+				
+		tempNumber = iter->number;
+		iter->number = lowestNumberNode->number;
+		lowestNumberNode->number = tempNumber;
 		
 		/* increment iter's weight by 1 */
 		iter->weight++;
+		coder->keys[iter->number - 1]++;
 				
 		/* iter = iter's parent */
 		iter = iter->parent;
@@ -577,45 +855,74 @@ static void FGKFASTTreeUpdate(FGKFASTCODER *coder, FGKFASTTREENODE *node, int sy
 	if (iter == coder->tree->root)
 	{
 		iter->weight++;
+		coder->keys[0]++;
+	}
+	
+	if (coder->tree->root->weight >= coder->weightLimit)
+	{
+		FGKFASTTreeRescale(coder);
 	}
 	
+	FGKFAST_CHECK(coder);
 }
 
 void FGKFASTEncoderEncode(FGKFASTENCODER *encoder, int symbol)
 { 
 	//printf("\n");
 	//printf("symbol = %d\n", symbol);
-	FGKFASTTREENODE *node = FGKFASTEncoderOutputCode(encoder, symbol);
-	FGKFASTTreeUpdate(encoder, node, symbol);	
+	FGKFASTTREENODE *node;
+	
+	PROFILE_BEGIN("fgkfast.enc.output");
+	node = FGKFASTEncoderOutputCode(encoder, symbol);
+	STATS_ADD(encoder, symbols, 1);
+	PROFILE_END("fgkfast.enc.output");
+	PROFILE_BEGIN("fgkfast.enc.update");
+	FGKFASTTreeUpdate(encoder, node, symbol);
+	PROFILE_END("fgkfast.enc.update");	
 	//PrintFGKFASTTree(encoder->tree->root);
 }
 
+/* end of the stream: the zero node code followed by a symbol already seen,
+ * which no real escape can carry. A stream without symbols needs none */
+void FGKFASTEncoderEnd(FGKFASTENCODER *encoder)
+{
+	int symbol;
+
+	for (symbol = 0; symbol < 256 && !isExisted(encoder, symbol); symbol++)
+	{
+	}
+	if (symbol < 256)
+	{
+		OutputZeroNodeCode(encoder, encoder->tree->zeroNode, symbol);
+	}
+}
+
 /* post-order traverse and delete tree nodes */
 static void FGKFASTTreeNodesDealloc(FGKFASTTREENODE *localRoot)  
 {
 	if (localRoot == NULL) return;
-	FGKFASTTreeNodesDealloc(localRoot->left);
-	FGKFASTTreeNodesDealloc(localRoot->right);
+	FGKFASTTreeNodesDealloc(localRoot->child[0]);
+	FGKFASTTreeNodesDealloc(localRoot->child[1]);
 	free(localRoot);
 }
 
-static void FGKFASTTreeDealloc(FGKFASTTREE *tree)
+static void FGKFASTTreeDealloc(FGKFASTTREE *tree, bool ownsNodes)
 {
 	if (tree == NULL) return;
-    FGKFASTTreeNodesDealloc(tree->root);
+    if (ownsNodes) FGKFASTTreeNodesDealloc(tree->root);
 	free(tree);
 }
 
 void FGKFASTEncoderDealloc(FGKFASTENCODER *encoder)
 {
 	if (encoder == NULL) return;
-    if (encoder->tree) FGKFASTTreeDealloc(encoder->tree);
+    if (encoder->tree) FGKFASTTreeDealloc(encoder->tree, encoder->arena == NULL);
 	free(encoder);
 }
 
-int FGKFASTEncoderBytesWrite(FGKFASTENCODER *encoder)
+long long FGKFASTEncoderBytesWrite(FGKFASTENCODER *encoder)
 {
-	return encoder->CurrentBytes;
+	return encoder->io->CurrentBytes;
 }
 
 static int FGKFASTDecoderInit(FGKFASTDECODER *decoder, void *stream, int IsFile)
@@ -623,11 +930,16 @@ static int FGKFASTDecoderInit(FGKFASTDECODER *decoder, void *stream, int IsFile)
 	int i;
 	decoder->IsFile = IsFile;	
 	decoder->OutBits = 0;
+	decoder->weightLimit = MAX_WEIGHT;
+	memset(&decoder->stats, 0, sizeof(HUFFMANSTATS));
 	decoder->CurrentBytes = 0;
 	decoder->rack = 0;
 	decoder->mask = 0x80;
 	decoder->stream = stream;
-	decoder->hasBit = false;
+	decoder->rawSymbols = true;
+	decoder->io = decoder;
+	decoder->arena = NULL;
+	decoder->hotLimit = 0;
 	
 	for (i = 0; i < 8; i++)
 	{
@@ -669,66 +981,54 @@ FGKFASTDECODER *FGKFASTDecoderAlloc(void *stream, int IsFile)
 	return decoder;
 }
 
-static FGKFASTTREENODE *isFeasible(int bit, FGKFASTTREENODE *node)
+static FGKFASTTREENODE *FGKFASTDecoderOutputSymbol(FGKFASTDECODER *decoder, int *symbol)
 {
-	FGKFASTTREENODE *iter = NULL;
+	int i, depth = 0;
+	FGKFASTTREENODE *node;
 	
-	if (bit == 0)
+#ifdef HUFFMAN_HOT_TOP
+	if (decoder->hotLimit == 0)
 	{
-		if (node->left != NULL)
-		{
-			iter = node->left;			
-		}
+		hotTopBuild(decoder);
 	}
-	else
+	
+	/* the top levels come from hotTop until a leaf or its last level */
+	i = 0;
+	while (i < (1 << FGKFAST_HOT_LEVELS) - 1 && !(decoder->hotLeaves & (1u << i)))
 	{
-		if (node->right != NULL)
-		{
-			iter = node->right;
-		}		
+		i = 2 * i + 1 + GetBit(decoder);
+		depth++;
 	}
-	return iter;
-}
-
-static FGKFASTTREENODE *FGKFASTDecoderOutputSymbol(FGKFASTDECODER *decoder, int *symbol)
-{
-	int bit, i;
-	FGKFASTTREENODE *node, *iter;
-	iter = decoder->tree->root;
+	node = decoder->hotTop[i];
+#else
+	node = decoder->tree->root;
+#endif
 	
-	/* read in first bit of child of root*/
-	if (decoder->hasBit)
+	/* internal nodes always have both children, so the walk stops on the
+	   leaf and reads exactly its code */
+	while (node->child[0] != NULL)
 	{
-		bit = decoder->bit;
+		node = node->child[GetBit(decoder)];
+		depth++;
 	}
-	else
+	STATS_MAX(decoder, maxDepth, depth);
+	
+	if (node->weight == 0)
 	{
-		bit = GetBit(decoder);	
+		STATS_ADD(decoder, escapes, 1);
 	}
- 
-	while ((node = isFeasible(bit, iter)) != NULL)
+	
+	if (node->weight == 0 && !decoder->rawSymbols)
 	{
-		bit = GetBit(decoder);
-		iter = node;
+		/* the symbol, if any, comes from whichever coder handles the escape */
+		*symbol = FGKFAST_ESCAPE;
 	}
-	
-	/* need to store the last bit since this is used to decode the next symbol or read in new symbol*/
-	decoder->bit = bit;
-	decoder->hasBit = true;
-	
-	node = iter;
-	
-	if (node->weight == 0)  // zero node
+	else if (node->weight == 0)  // zero node
 	{
 		/* read the new symbol */
-		bit = decoder->bit;
-		decoder->hasBit = false;
-		*symbol |= bit;		
-		for (i = 0; i < 7; i++)
-		{
-			*symbol <<= 1;
-			bit = GetBit(decoder);
-			*symbol |= bit;
+		for (i = 0; i < 8; i++)
+		{
+			*symbol = (*symbol << 1) | GetBit(decoder);
 		}
 	}
 	else
@@ -743,24 +1043,350 @@ int FGKFASTDecoderDecode(FGKFASTDECODER *decoder)
 {
 	int symbol = 0;
 	
-	FGKFASTTREENODE *node = FGKFASTDecoderOutputSymbol(decoder, &symbol);
+	FGKFASTTREENODE *node;
+	
+	PROFILE_BEGIN("fgkfast.dec.input");
+	node = FGKFASTDecoderOutputSymbol(decoder, &symbol);
+	PROFILE_END("fgkfast.dec.input");
+	STATS_ADD(decoder, symbols, 1);
 	//printf("\n");
 	//printf("symbol = %d\n", symbol);
 	
-	FGKFASTTreeUpdate(decoder, node, symbol);	
+	/* the caller learns the symbol elsewhere and passes it to FGKFASTCoderUpdate() */
+	if (symbol == FGKFAST_ESCAPE)
+	{
+		return symbol;
+	}
+	if (node->weight == 0 && isExisted(decoder, symbol))
+	{
+		return FGKFAST_END;
+	}
+	
+	PROFILE_BEGIN("fgkfast.dec.update");
+	FGKFASTTreeUpdate(decoder, node, symbol);
+	PROFILE_END("fgkfast.dec.update");
 	//PrintFGKFASTTree(decoder->tree->root);
 	
 	return symbol;
 }
 
+/* decode up to length symbols into output; returns how many, fewer only at
+ * the end of the stream, or -1 at an escape. Node 2, the heavier child of
+ * the root, is never outweighed below the root, so coding its leaf swaps
+ * nothing and only adds to it and the root. While it is a leaf, the repeats
+ * of its one-bit code left in the byte being read are taken together with
+ * that fused update, without walking the tree */
+int FGKFASTDecoderDecodeMany(FGKFASTDECODER *decoder, unsigned char *output, int length)
+{
+	FGKFASTDECODER *io = decoder->io;
+	FGKFASTTREENODE *root, *top;
+	int count = 0, run, symbol;
+
+	while (count < length)
+	{
+		symbol = FGKFASTDecoderDecode(decoder);
+		if (symbol == FGKFAST_END)
+		{
+			break;
+		}
+		/* the symbol of an escape is up to whoever shares the coder */
+		if (symbol == FGKFAST_ESCAPE)
+		{
+			return -1;
+		}
+		output[count++] = (unsigned char)symbol;
+
+		root = decoder->tree->root;
+		top = decoder->nodeList[1];
+		if (decoder->tree->maxNumber < 3 || top->child[0] != NULL)
+		{
+			continue;
+		}
+		/* stop short of the update that halves the weights */
+		for (run = 0; count + run < length && io->mask != 0x80
+			&& ((io->rack & io->mask) != 0) == top->side
+			&& root->weight + run + 1 < decoder->weightLimit; run++)
+		{
+			io->mask >>= 1;
+			if (io->mask == 0)
+			{
+				io->mask = 0x80;
+			}
+		}
+		if (run > 0)
+		{
+			memset(output + count, top->symbol, run);
+			count += run;
+			top->weight += run;
+			root->weight += run;
+			decoder->keys[1] += run;
+			decoder->keys[0] += run;
+			STATS_ADD(decoder, symbols, run);
+			STATS_ADD(decoder, codeBits, run);
+		}
+	}
+
+	return count;
+}
+
 void FGKFASTDecoderDealloc(FGKFASTDECODER *decoder)
 {
 	if (decoder == NULL) return;
-    if (decoder->tree) FGKFASTTreeDealloc(decoder->tree);
+    if (decoder->tree) FGKFASTTreeDealloc(decoder->tree, decoder->arena == NULL);
 	free(decoder);
 }
 
-int FGKFASTDecoderBytesRead(FGKFASTDECODER *decoder)
+long long FGKFASTDecoderBytesRead(FGKFASTDECODER *decoder)
+{
+	return decoder->io->CurrentBytes;
+}
+
+void FGKFASTCoderSetWeightLimit(FGKFASTCODER *coder, int weightLimit)
 {
-	return decoder->CurrentBytes;
-}
\ No newline at end of file
+	if (weightLimit > 0 && weightLimit < MIN_WEIGHT_LIMIT)
+	{
+		weightLimit = MIN_WEIGHT_LIMIT;
+	}
+	/* 0 means no periodic halving, only the overflow guard */
+	if (weightLimit <= 0 || weightLimit > MAX_WEIGHT)
+	{
+		weightLimit = MAX_WEIGHT;
+	}
+	coder->weightLimit = weightLimit;
+}
+
+/* a coder with its own tree that reads and writes the bit stream of io and 
+ * takes its nodes from arena (may be NULL); a symbol it has not seen is sent
+ * as the zero node code only, and decoding that code gives FGKFAST_ESCAPE */
+FGKFASTCODER *FGKFASTCoderAllocShared(FGKFASTCODER *io, FGKFASTARENA *arena)
+{
+	FGKFASTCODER *coder;
+	int i;
+
+	if ((coder = (FGKFASTCODER *) malloc (sizeof(FGKFASTCODER))) == NULL)
+	{
+		printf("FGKFASTCoderAllocShared(): fail to allocate FGKFAST coder.\n");
+		return NULL;
+	}
+
+	coder->IsFile = io->IsFile;	
+	coder->OutBits = 0;
+	coder->weightLimit = MAX_WEIGHT;
+	memset(&coder->stats, 0, sizeof(HUFFMANSTATS));
+	coder->CurrentBytes = 0;
+	coder->rack = 0;
+	coder->mask = 0x80;
+	coder->stream = io->stream;
+	coder->rawSymbols = false;
+	coder->io = io;
+	coder->arena = arena;
+	coder->hotLimit = 0;
+	
+	for (i = 0; i < 8; i++)
+	{
+		coder->symbolRecord[i] = 0;
+	}
+	
+	if ((coder->tree = (FGKFASTTREE *) malloc (sizeof(FGKFASTTREE))) == NULL
+		|| FGKFASTTreeInit(coder) == -1)
+	{
+		printf("FGKFASTCoderAllocShared(): fail to initiate FGKFAST tree!\n");
+		free(coder);
+		return NULL;
+	}
+	
+	return coder;
+}
+
+void FGKFASTCoderDealloc(FGKFASTCODER *coder)
+{
+	FGKFASTEncoderDealloc(coder);
+}
+
+bool FGKFASTCoderHasSymbol(FGKFASTCODER *coder, int symbol)
+{
+	return isExisted(coder, symbol);
+}
+
+/* update the tree as if symbol had been coded, without any bits */
+void FGKFASTCoderUpdate(FGKFASTCODER *coder, int symbol)
+{
+	FGKFASTTREENODE *node;
+	
+	if (isExisted(coder, symbol))
+	{
+		node = findNode(coder, symbol);
+	}
+	else
+	{
+		node = coder->tree->zeroNode;
+	}
+	
+	FGKFASTTreeUpdate(coder, node, symbol);
+}
+
+/* add k to the weight of symbol. Small k repeats the single update; larger k
+ * does one single update, adds the rest along the path to the root and 
+ * rebuilds the tree once. The result is a Huffman tree for the same weights,
+ * not always the one k single updates would give, so encoder and decoder
+ * must both use this call for the same symbols. */
+void FGKFASTCoderUpdateBy(FGKFASTCODER *coder, int symbol, int k)
+{
+	FGKFASTTREENODE *node;
+
+	if (k <= FGKFAST_BULK_UPDATE)
+	{
+		for ( ; k > 0; k--)
+		{
+			node = isExisted(coder, symbol) ? findNode(coder, symbol) : coder->tree->zeroNode;
+			FGKFASTTreeUpdate(coder, node, symbol);
+		}
+		return;
+	}
+
+	node = isExisted(coder, symbol) ? findNode(coder, symbol) : coder->tree->zeroNode;
+	FGKFASTTreeUpdate(coder, node, symbol);
+
+	k--;
+	if (k > MAX_WEIGHT - coder->tree->root->weight)
+	{
+		k = MAX_WEIGHT - coder->tree->root->weight;
+	}
+	for (node = findNode(coder, symbol); node != NULL; node = node->parent)
+	{
+		node->weight += k;
+	}
+	FGKFASTTreeRebuild(coder, false);
+
+	while (coder->tree->root->weight >= coder->weightLimit)
+	{
+		FGKFASTTreeRescale(coder);
+	}
+	
+	FGKFAST_CHECK(coder);
+}
+
+const HUFFMANSTATS *FGKFASTCoderStats(FGKFASTCODER *coder)
+{
+	return &coder->stats;
+}
+
+
+/* copy the model of coder, its tree and the symbols it has seen, to state */
+void FGKFASTCoderSaveState(FGKFASTCODER *coder, CODERSTATE *state)
+{
+	FGKFASTTREENODE *node;
+	int i;
+
+	state->numNodes = coder->tree->maxNumber;
+	for (i = 0; i < 8; i++)
+	{
+		state->symbolRecord[i] = coder->symbolRecord[i];
+	}
+	for (i = 0; i < coder->tree->maxNumber; i++)
+	{
+		node = coder->nodeList[i];
+		state->nodes[i].symbol = node->symbol;
+		state->nodes[i].weight = node->weight;
+		state->nodes[i].parent = (node->parent == NULL) ? 0 : node->parent->number;
+	}
+}
+
+
+/* replace the model of coder by state; the bit stream is left alone */
+int FGKFASTCoderLoadState(FGKFASTCODER *coder, const CODERSTATE *state)
+{
+	FGKFASTTREENODE *node, *parent;
+	int i;
+
+	if (StateCheck(state) == -1)
+	{
+		printf("FGKFASTCoderLoadState(): not a valid coder state.\n");
+		return -1;
+	}
+
+	/* nodes in an arena stay there until the arena goes */
+	if (coder->arena == NULL)
+	{
+		FGKFASTTreeNodesDealloc(coder->tree->root);
+	}
+	coder->tree->maxNumber = 0;
+	for (i = 0; i < state->numNodes; i++)
+	{
+		/* numbered i + 1, and the last one made is the zero node */
+		if ((node = FGKFASTTreeNodeInit(coder)) == NULL)
+		{
+			printf("FGKFASTCoderLoadState(): fail to allocate nodes, coder is unusable.\n");
+			return -1;
+		}
+		node->symbol = state->nodes[i].symbol;
+		node->weight = state->nodes[i].weight;
+		if (i > 0)
+		{
+			/* the left child comes first */
+			parent = coder->nodeList[state->nodes[i].parent - 1];
+			node->side = (parent->child[0] == NULL) ? 0 : 1;
+			node->parent = parent;
+			parent->child[node->side] = node;
+		}
+	}
+	coder->tree->root = coder->nodeList[0];
+	coder->hotLimit = 0;
+
+	for (i = 0; i < state->numNodes; i++)
+	{
+		coder->keys[i] = coder->nodeList[i]->weight;
+	}
+	for (i = 0; i < 8; i++)
+	{
+		coder->symbolRecord[i] = state->symbolRecord[i];
+	}
+
+	FGKFAST_CHECK(coder);
+
+	return 0;
+}
+
+
+/* bits written so far, those still waiting in the rack included */
+long long FGKFASTEncoderBitsWrite(FGKFASTENCODER *encoder)
+{
+	unsigned char mask;
+	int bits = 0;
+
+	encoder = encoder->io;
+	for (mask = encoder->mask; mask != 0x80; mask <<= 1)
+	{
+		bits++;
+	}
+
+	return encoder->CurrentBytes * 8 + bits;
+}
+
+
+/* go on decoding at bit position bits of a stream of length bytes in
+ * memory, such as one taken by FGKFASTEncoderBitsWrite() between two symbols */
+int FGKFASTDecoderSeek(FGKFASTDECODER *decoder, long long bits, long long length)
+{
+	decoder = decoder->io;
+	if (decoder->IsFile)
+	{
+		printf("FGKFASTDecoderSeek(): can only seek in a stream in memory.\n");
+		return -1;
+	}
+	if (bits < 0 || bits > length * 8)
+	{
+		printf("FGKFASTDecoderSeek(): bit %lld is outside the stream.\n", bits);
+		return -1;
+	}
+
+	decoder->CurrentBytes = bits / 8;
+	decoder->mask = 0x80;
+	if (bits % 8 != 0)
+	{
+		decoder->rack = GetByte(decoder->stream, &(decoder->CurrentBytes), decoder->IsFile);
+		decoder->mask = 0x80 >> (bits % 8);
+	}
+
+	return 0;
+}
@@ -12,16 +12,25 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include "stats.h"
+#include "state.h"
+#include "weight.h"
 
 #define NUM_BITS_IN_INT      32
+#define FGKFAST_END          256	/* decoded the end of the stream */
+#define FGKFAST_BULK_UPDATE  16	/* larger increments rebuild the tree once */
+#define FGKFAST_ESCAPE       -1	/* decoded the zero node of a coder without raw symbols */
+#define FGKFAST_ARENA_CHUNK  1024
+#define FGKFAST_HOT_LEVELS   4	/* levels below the root a decoder walks in hotTop, at most 4 for hotLeaves */
+#define FGKFAST_HOT_SIZE     ((2 << FGKFAST_HOT_LEVELS) - 1)
 
 typedef struct FGKFASTNode
 {
 	int symbol;
 	int weight;
 	int number;
-	bool isLeft;
-	struct FGKFASTNode *parent, *left, *right;
+	int side;	/* 0 if left child, 1 if right child */
+	struct FGKFASTNode *parent, *child[2];	/* left, right */
 }FGKFASTTREENODE;
 
 typedef struct
@@ -31,18 +40,39 @@ typedef struct
 	int maxNumber;
 }FGKFASTTREE;
 
-typedef struct 
+typedef struct FGKFASTArenaChunk
+{
+	FGKFASTTREENODE nodes[FGKFAST_ARENA_CHUNK];
+	struct FGKFASTArenaChunk *next;
+}FGKFASTARENACHUNK;
+
+/* node storage shared by several coders, freed all at once */
+typedef struct
+{
+	FGKFASTARENACHUNK *chunk;
+	int used;
+}FGKFASTARENA;
+
+typedef struct FGKFASTCoder
 {
 	int IsFile;	
-    int rack, value, CurrentBytes;
+    int rack, value;
+	long long CurrentBytes;
 	int InBits, OutBits;
 	int symbolRecord[8];
-	int bit;
-	bool hasBit;
+	int weightLimit;	/* root weight at which all weights are halved */
+	HUFFMANSTATS stats;	/* counted with HUFFMAN_STATS */
+	bool rawSymbols;	/* false: a new symbol is sent by the zero node code alone */
 	unsigned char mask;
 	void *stream;
+	struct FGKFASTCoder *io;	/* coder owning the bit stream, itself unless shared */
+	FGKFASTARENA *arena;	/* node storage, NULL to malloc every node */
 	FGKFASTTREE *tree;
 	FGKFASTTREENODE *nodeList[513];
+	unsigned int keys[513];	/* weight of nodeList[i], dense for the block scans */
+	FGKFASTTREENODE *hotTop[FGKFAST_HOT_SIZE];	/* nodes of the top levels in heap order, NULL below a leaf */
+	unsigned int hotLeaves;	/* bit i set if hotTop[i] is a leaf */
+	int hotLimit;	/* highest number in hotTop, 0 when hotTop must be rebuilt */
 } FGKFASTENCODER, FGKFASTDECODER, FGKFASTCODER;
 
 
@@ -51,11 +81,26 @@ typedef struct
 void FGKFASTEncoderFlush(FGKFASTENCODER *encoder);
 FGKFASTENCODER *FGKFASTEncoderAlloc(void *stream, int IsFile);
 void FGKFASTEncoderEncode(FGKFASTENCODER *encoder, int symbol);
+void FGKFASTEncoderEnd(FGKFASTENCODER *encoder);
 void FGKFASTEncoderDealloc(FGKFASTENCODER *encoder);
-int FGKFASTEncoderBytesWrite(FGKFASTDECODER *encoder);
-FGKFASTDECODER *FGKFASTDEcoderAlloc(void *stream, int IsFile);
+long long FGKFASTEncoderBytesWrite(FGKFASTDECODER *encoder);
+FGKFASTDECODER *FGKFASTDecoderAlloc(void *stream, int IsFile);
 int FGKFASTDecoderDecode(FGKFASTDECODER *decoder);
+int FGKFASTDecoderDecodeMany(FGKFASTDECODER *decoder, unsigned char *output, int length);
 void FGKFASTDecoderDealloc(FGKFASTDECODER *decoder);
-int FGKFASTDecoderBytesRead(FGKFASTDECODER *decoder);
+long long FGKFASTDecoderBytesRead(FGKFASTDECODER *decoder);
+void FGKFASTCoderSetWeightLimit(FGKFASTCODER *coder, int weightLimit);
+const HUFFMANSTATS *FGKFASTCoderStats(FGKFASTCODER *coder);
+void FGKFASTCoderUpdateBy(FGKFASTCODER *coder, int symbol, int k);
+void FGKFASTCoderSaveState(FGKFASTCODER *coder, CODERSTATE *state);
+int FGKFASTCoderLoadState(FGKFASTCODER *coder, const CODERSTATE *state);
+long long FGKFASTEncoderBitsWrite(FGKFASTENCODER *encoder);
+int FGKFASTDecoderSeek(FGKFASTDECODER *decoder, long long bits, long long length);
+FGKFASTCODER *FGKFASTCoderAllocShared(FGKFASTCODER *io, FGKFASTARENA *arena);
+void FGKFASTCoderDealloc(FGKFASTCODER *coder);
+bool FGKFASTCoderHasSymbol(FGKFASTCODER *coder, int symbol);
+void FGKFASTCoderUpdate(FGKFASTCODER *coder, int symbol);
+FGKFASTARENA *FGKFASTArenaAlloc(void);
+void FGKFASTArenaDealloc(FGKFASTARENA *arena);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,152 @@
+/*************************************************************************
+ *
+ *	File:	fuzz.c
+ *	Author:  Jing Huang & Liang Wu
+ *
+ *	Description: libFuzzer entry point. Each input is round tripped through
+ *  every engine with HuffmanVerify(), then read back as a stream that may
+ *  be corrupt: once as a whole file (header and code), and once as bare
+ *  code fed to the decoder of every engine. Built on its own, without
+ *  main.c, and with -DHUFFMAN_DEBUG so the trees are checked after every
+ *  update:
+ *
+ *    clang -g -O1 -fsanitize=fuzzer,address,undefined -DHUFFMAN_DEBUG \
+ *        -o fuzz fuzz.c batch.c block.c huffman.c fgk.c fgkFast.c vitter.c \
+ *        vitterFast.c order1.c rle.c stats.c state.c checkpoint.c iochain.c \
+ *        timer.c perf.c -lpthread -lm
+ *
+ *  With -DFUZZ_STANDALONE instead of -fsanitize=fuzzer, any compiler builds
+ *  a program that replays the files named on its command line.
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "huffman.h"
+#include "batch.h"
+#include "iochain.h"
+
+#define FUZZ_MAX_LENGTH     (1 << 24)	/* larger decoded lengths are not tried */
+#define FUZZ_MAX_BLOCK      (1 << 16)	/* nor larger blocks, which are allocated in full */
+
+
+/* decode data as a whole file into /dev/null */
+static void FuzzDecodeFile(const uint8_t *data, size_t size)
+{
+	BATCHOPTIONS options;
+	HUFFMANHEADER header;
+	FILE *in, *out;
+
+	/* skip headers that would only make the decoder allocate a lot */
+	if ((in = fmemopen((void *)data, size, "rb")) == NULL)
+	{
+		return;
+	}
+	if (HuffmanHeaderRead(in, &header) == -1 || header.length > FUZZ_MAX_LENGTH
+		|| header.blockSize > FUZZ_MAX_BLOCK)
+	{
+		fclose(in);
+		return;
+	}
+	rewind(in);
+
+	if ((out = fopen("/dev/null", "wb")) != NULL)
+	{
+		memset(&options, 0, sizeof(options));
+		options.threads = 1;
+		options.decompress = true;
+		BatchDecompressStream(in, out, &options, &header);
+		fclose(out);
+	}
+	fclose(in);
+}
+
+
+/* decode data as bare code with every engine; every symbol takes at least
+ * one bit, so 8 symbols a byte reach past the end, where the chain reads EOF */
+static void FuzzDecodeCode(const uint8_t *data, size_t size)
+{
+	const HUFFMANENGINE *engine;
+	struct iovec code;
+	IOCHAIN chain;
+	unsigned char *output;
+	void *decoder;
+	int id, limit = 8 * (int)size + 8;
+
+	if ((output = (unsigned char *) malloc (limit)) == NULL)
+	{
+		return;
+	}
+
+	for (id = 0; (engine = HuffmanEngine(id)) != NULL; id++)
+	{
+		code.iov_base = (void *)data;
+		code.iov_len = size;
+		IOChainInit(&chain, &code, 1);
+		if ((decoder = engine->DecoderAlloc(&chain, IOCHAIN_STREAM)) == NULL)
+		{
+			continue;
+		}
+		engine->CoderSetWeightLimit(decoder, MIN_WEIGHT_LIMIT);
+		engine->DecoderDecodeMany(decoder, output, limit);
+		engine->DecoderDealloc(decoder);
+	}
+
+	free(output);
+}
+
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	if (size > FUZZ_MAX_BLOCK)
+	{
+		return 0;
+	}
+
+	if (HuffmanVerify((unsigned char *)data, (int)size, 0) != 0
+		|| HuffmanVerify((unsigned char *)data, (int)size, MIN_WEIGHT_LIMIT) != 0)
+	{
+		abort();
+	}
+	FuzzDecodeFile(data, size);
+	FuzzDecodeCode(data, size);
+
+	return 0;
+}
+
+
+#ifdef FUZZ_STANDALONE
+int main(int argc, char *argv[])
+{
+	unsigned char *data;
+	long size;
+	FILE *stream;
+	int i;
+
+	for (i = 1; i < argc; i++)
+	{
+		if ((stream = fopen(argv[i], "rb")) == NULL)
+		{
+			printf("main(): fail to open %s.\n", argv[i]);
+			return 1;
+		}
+		fseek(stream, 0, SEEK_END);
+		size = ftell(stream);
+		rewind(stream);
+		if ((data = (unsigned char *) malloc (size + 1)) == NULL
+			|| fread(data, 1, size, stream) != (size_t)size)
+		{
+			printf("main(): fail to read %s.\n", argv[i]);
+			return 1;
+		}
+		fclose(stream);
+
+		LLVMFuzzerTestOneInput(data, size);
+		free(data);
+	}
+
+	return 0;
+}
+#endif
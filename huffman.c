@@ -0,0 +1,613 @@
+/*************************************************************************
+ *
+ *	File:	huffman.c
+ *	Author:  Jing Huang & Liang Wu
+ *
+ *	Description: runtime selection of the adaptive Huffman engines,
+ *  including an auto mode that picks an engine from a sample prefix.
+ *
+ ************************************************************************/
+
+#include <string.h>
+#include "huffman.h"
+#include "checkpoint.h"
+#include "timer.h"
+
+
+/* DecoderDecodeMany of an engine that decodes one symbol at a time */
+static int HuffmanDecodeEach(int (*decode)(void *decoder), void *decoder, unsigned char *output, int length)
+{
+	int i, symbol;
+
+	for (i = 0; i < length; i++)
+	{
+		symbol = decode(decoder);
+		if (symbol == HUFFMAN_END)
+		{
+			break;
+		}
+		if (symbol < 0 || symbol > 255)
+		{
+			return -1;
+		}
+		output[i] = (unsigned char)symbol;
+	}
+
+	return i;
+}
+
+
+/* type-safe adapters from the generic engine table to each engine's API */
+#define HUFFMAN_ENGINE_ADAPTERS(PREFIX, ENCODER, DECODER) \
+static void *PREFIX##EncAlloc(void *stream, int IsFile) { return PREFIX##EncoderAlloc(stream, IsFile); } \
+static void PREFIX##EncEnd(void *encoder) { PREFIX##EncoderEnd((ENCODER *)encoder); } \
+static void PREFIX##EncFlush(void *encoder) { PREFIX##EncoderFlush((ENCODER *)encoder); } \
+static void PREFIX##EncDealloc(void *encoder) { PREFIX##EncoderDealloc((ENCODER *)encoder); } \
+static long long PREFIX##EncBytesWrite(void *encoder) { return PREFIX##EncoderBytesWrite((ENCODER *)encoder); } \
+static void *PREFIX##DecAlloc(void *stream, int IsFile) { return PREFIX##DecoderAlloc(stream, IsFile); } \
+static int PREFIX##DecDecode(void *decoder) { return PREFIX##DecoderDecode((DECODER *)decoder); } \
+static void PREFIX##DecDealloc(void *decoder) { PREFIX##DecoderDealloc((DECODER *)decoder); } \
+static long long PREFIX##DecBytesRead(void *decoder) { return PREFIX##DecoderBytesRead((DECODER *)decoder); } \
+static void PREFIX##SetWeightLimit(void *coder, int weightLimit) { PREFIX##CoderSetWeightLimit((ENCODER *)coder, weightLimit); }
+
+/* engines whose encoder cannot fail once allocated */
+#define HUFFMAN_ENGINE_ENCODE(PREFIX, ENCODER) \
+static int PREFIX##EncEncode(void *encoder, int symbol) { PREFIX##EncoderEncode((ENCODER *)encoder, symbol); return 0; }
+
+/* engines that allocate while they code and return -1 when they cannot */
+#define HUFFMAN_ENGINE_ENCODE_CHECKED(PREFIX, ENCODER) \
+static int PREFIX##EncEncode(void *encoder, int symbol) { return PREFIX##EncoderEncode((ENCODER *)encoder, symbol); }
+
+/* engines that decode a run of symbols in one call */
+#define HUFFMAN_ENGINE_DECODE_MANY(PREFIX, DECODER) \
+static int PREFIX##DecDecodeMany(void *decoder, unsigned char *output, int length) \
+	{ return PREFIX##DecoderDecodeMany((DECODER *)decoder, output, length); }
+
+#define HUFFMAN_ENGINE_DECODE_EACH(PREFIX) \
+static int PREFIX##DecDecodeMany(void *decoder, unsigned char *output, int length) \
+	{ return HuffmanDecodeEach(PREFIX##DecDecode, decoder, output, length); }
+
+#define HUFFMAN_ENGINE_STATS(PREFIX, CODER) \
+static const HUFFMANSTATS *PREFIX##Stats(void *coder) { return PREFIX##CoderStats((CODER *)coder); }
+
+#define HUFFMAN_ENGINE_NO_STATS(PREFIX) \
+static const HUFFMANSTATS *PREFIX##Stats(void *coder) { return NULL; }
+
+#define HUFFMAN_ENGINE_STATE(PREFIX, ENCODER, DECODER, CODER) \
+static int PREFIX##SaveState(void *coder, CODERSTATE *state) { PREFIX##CoderSaveState((CODER *)coder, state); return 0; } \
+static int PREFIX##LoadState(void *coder, const CODERSTATE *state) { return PREFIX##CoderLoadState((CODER *)coder, state); } \
+static long long PREFIX##EncBitsWrite(void *encoder) { return PREFIX##EncoderBitsWrite((ENCODER *)encoder); } \
+static int PREFIX##DecSeek(void *decoder, long long bits, long long length) { return PREFIX##DecoderSeek((DECODER *)decoder, bits, length); }
+
+#define HUFFMAN_ENGINE_NO_STATE(PREFIX) \
+static int PREFIX##SaveState(void *coder, CODERSTATE *state) { return -1; } \
+static int PREFIX##LoadState(void *coder, const CODERSTATE *state) { return -1; } \
+static long long PREFIX##EncBitsWrite(void *encoder) { return -1; } \
+static int PREFIX##DecSeek(void *decoder, long long bits, long long length) { return -1; }
+
+/* engines that add k to a symbol's weight in one update */
+#define HUFFMAN_ENGINE_UPDATE_BY(PREFIX, CODER) \
+static void PREFIX##UpdateBy(void *coder, int symbol, int k) { PREFIX##CoderUpdateBy((CODER *)coder, symbol, k); }
+
+#define HUFFMAN_ENGINE_ENTRY(ID, NAME, PREFIX) \
+	{ ID, NAME, PREFIX##EncAlloc, PREFIX##EncEncode, PREFIX##EncEnd, PREFIX##EncFlush, PREFIX##EncDealloc, PREFIX##EncBytesWrite, \
+	  PREFIX##DecAlloc, PREFIX##DecDecode, PREFIX##DecDecodeMany, PREFIX##DecDealloc, PREFIX##DecBytesRead, PREFIX##SetWeightLimit, \
+	  PREFIX##Stats, PREFIX##SaveState, PREFIX##LoadState, PREFIX##EncBitsWrite, PREFIX##DecSeek }
+
+HUFFMAN_ENGINE_ADAPTERS(FGK, FGKENCODER, FGKDECODER)
+HUFFMAN_ENGINE_ADAPTERS(FGKFAST, FGKFASTENCODER, FGKFASTDECODER)
+HUFFMAN_ENGINE_ADAPTERS(VITTER, VITTERENCODER, VITTERDECODER)
+HUFFMAN_ENGINE_ADAPTERS(VITTERFAST, VITTERFASTENCODER, VITTERFASTDECODER)
+HUFFMAN_ENGINE_ADAPTERS(ORDER1, ORDER1ENCODER, ORDER1DECODER)
+HUFFMAN_ENGINE_ADAPTERS(RLE, RLEENCODER, RLEDECODER)
+
+HUFFMAN_ENGINE_ENCODE(FGK, FGKENCODER)
+HUFFMAN_ENGINE_ENCODE(FGKFAST, FGKFASTENCODER)
+HUFFMAN_ENGINE_ENCODE(VITTER, VITTERENCODER)
+HUFFMAN_ENGINE_ENCODE(VITTERFAST, VITTERFASTENCODER)
+HUFFMAN_ENGINE_ENCODE_CHECKED(ORDER1, ORDER1ENCODER)
+HUFFMAN_ENGINE_ENCODE(RLE, RLEENCODER)
+
+HUFFMAN_ENGINE_DECODE_EACH(FGK)
+HUFFMAN_ENGINE_DECODE_MANY(FGKFAST, FGKFASTDECODER)
+HUFFMAN_ENGINE_DECODE_EACH(VITTER)
+HUFFMAN_ENGINE_DECODE_MANY(VITTERFAST, VITTERFASTDECODER)
+HUFFMAN_ENGINE_DECODE_EACH(ORDER1)
+HUFFMAN_ENGINE_DECODE_EACH(RLE)
+
+HUFFMAN_ENGINE_NO_STATS(FGK)
+HUFFMAN_ENGINE_STATS(FGKFAST, FGKFASTCODER)
+HUFFMAN_ENGINE_NO_STATS(VITTER)
+HUFFMAN_ENGINE_STATS(VITTERFAST, VITTERFASTCODER)
+HUFFMAN_ENGINE_NO_STATS(ORDER1)
+HUFFMAN_ENGINE_NO_STATS(RLE)
+
+HUFFMAN_ENGINE_NO_STATE(FGK)
+HUFFMAN_ENGINE_STATE(FGKFAST, FGKFASTENCODER, FGKFASTDECODER, FGKFASTCODER)
+HUFFMAN_ENGINE_NO_STATE(VITTER)
+HUFFMAN_ENGINE_STATE(VITTERFAST, VITTERFASTENCODER, VITTERFASTDECODER, VITTERFASTCODER)
+HUFFMAN_ENGINE_NO_STATE(ORDER1)
+HUFFMAN_ENGINE_NO_STATE(RLE)
+
+HUFFMAN_ENGINE_UPDATE_BY(FGKFAST, FGKFASTCODER)
+HUFFMAN_ENGINE_UPDATE_BY(VITTERFAST, VITTERFASTCODER)
+
+static const HUFFMANENGINE engines[HUFFMAN_NUM_ENGINES] =
+{
+	HUFFMAN_ENGINE_ENTRY(HUFFMAN_ENGINE_FGK, "fgk", FGK),
+	HUFFMAN_ENGINE_ENTRY(HUFFMAN_ENGINE_FGK_FAST, "fgkfast", FGKFAST),
+	HUFFMAN_ENGINE_ENTRY(HUFFMAN_ENGINE_VITTER, "vitter", VITTER),
+	HUFFMAN_ENGINE_ENTRY(HUFFMAN_ENGINE_VITTER_FAST, "vitterfast", VITTERFAST),
+	HUFFMAN_ENGINE_ENTRY(HUFFMAN_ENGINE_ORDER1, "order1", ORDER1),
+	HUFFMAN_ENGINE_ENTRY(HUFFMAN_ENGINE_RLE, "rle", RLE)
+};
+
+
+const HUFFMANENGINE *HuffmanEngine(int id)
+{
+	if (id < 0 || id >= HUFFMAN_NUM_ENGINES)
+	{
+		return NULL;
+	}
+
+	return &engines[id];
+}
+
+
+int HuffmanEngineByName(const char *name)
+{
+	int i;
+
+	if (strcmp(name, "auto") == 0)
+	{
+		return HUFFMAN_ENGINE_AUTO;
+	}
+
+	for (i = 0; i < HUFFMAN_NUM_ENGINES; i++)
+	{
+		if (strcmp(name, engines[i].name) == 0)
+		{
+			return engines[i].id;
+		}
+	}
+
+	return HUFFMAN_ENGINE_UNKNOWN;
+}
+
+
+/* worst case: a new symbol costs a 256-bit path to the zero node plus 8 raw bits */
+long long HuffmanEncodeBound(long long length)
+{
+	return length * 33 + 64;
+}
+
+
+/* code the sample with every engine and score each by
+ * ratioWeight * (smallest output / output) + (1 - ratioWeight) * (fastest time / time) */
+int HuffmanEngineAuto(unsigned char *sample, int length, double ratioWeight)
+{
+	unsigned char *buffer;
+	void *encoder;
+	const HUFFMANENGINE *engine;
+	long long bytes[HUFFMAN_NUM_ENGINES];
+	double seconds[HUFFMAN_NUM_ENGINES];
+	double score, bestScore;
+	long long minBytes;
+	int i, j, best;
+	double minSeconds;
+
+	if (length > HUFFMAN_AUTO_SAMPLE)
+	{
+		length = HUFFMAN_AUTO_SAMPLE;
+	}
+
+	if ((buffer = (unsigned char *) malloc (HuffmanEncodeBound(length))) == NULL)
+	{
+		printf("HuffmanEngineAuto(): fail to allocate sample buffer.\n");
+		return HUFFMAN_ENGINE_FGK_FAST;
+	}
+
+	for (i = 0; i < HUFFMAN_NUM_ENGINES; i++)
+	{
+		engine = &engines[i];
+		/* an engine that cannot code the sample is left out, bytes = -1 */
+		bytes[i] = -1;
+		if ((encoder = engine->EncoderAlloc(buffer, 0)) == NULL)
+		{
+			printf("HuffmanEngineAuto(): %s fails to allocate, skipped.\n", engine->name);
+			continue;
+		}
+
+		StartTimer();
+		for (j = 0; j < length; j++)
+		{
+			if (engine->EncoderEncode(encoder, sample[j]) == -1)
+			{
+				break;
+			}
+		}
+		engine->EncoderFlush(encoder);
+		StopTimer();
+
+		if (j < length)
+		{
+			printf("HuffmanEngineAuto(): %s fails to encode byte %d, skipped.\n", engine->name, j);
+			engine->EncoderDealloc(encoder);
+			continue;
+		}
+		bytes[i] = engine->EncoderBytesWrite(encoder);
+		seconds[i] = ElapsedTime();
+		if (seconds[i] <= 0)
+		{
+			/* below the timer resolution */
+			seconds[i] = 1e-6;
+		}
+		engine->EncoderDealloc(encoder);
+	}
+	free(buffer);
+
+	minBytes = -1;
+	minSeconds = 0;
+	for (i = 0; i < HUFFMAN_NUM_ENGINES; i++)
+	{
+		if (bytes[i] == -1)
+		{
+			continue;
+		}
+		if (minBytes == -1 || bytes[i] < minBytes) minBytes = bytes[i];
+		if (minSeconds == 0 || seconds[i] < minSeconds) minSeconds = seconds[i];
+	}
+	if (minBytes == -1)
+	{
+		return HUFFMAN_ENGINE_FGK_FAST;
+	}
+
+	best = 0;
+	bestScore = -1;
+	for (i = 0; i < HUFFMAN_NUM_ENGINES; i++)
+	{
+		if (bytes[i] == -1)
+		{
+			continue;
+		}
+		score = ratioWeight * ((double)(minBytes + 1) / (bytes[i] + 1))
+			+ (1 - ratioWeight) * (minSeconds / seconds[i]);
+		if (score > bestScore)
+		{
+			bestScore = score;
+			best = i;
+		}
+	}
+
+	return engines[best].id;
+}
+
+
+/* seek decoder, over the bytes bytes of code, to a few places of data
+ * through index and decode a little from each; returns -1 on the first
+ * wrong byte */
+static int HuffmanVerifySeek(CHECKPOINTINDEX *index, void *decoder, long long bytes, unsigned char *data, int length)
+{
+	long long targets[4];
+	int i, j, symbol;
+
+	/* before the first checkpoint, at one, between two and near the end */
+	targets[0] = length / 8;
+	targets[1] = index->interval;
+	targets[2] = length / 2 + 1;
+	targets[3] = length - 1;
+
+	for (i = 0; i < 4; i++)
+	{
+		if (targets[i] < 0 || targets[i] >= length)
+		{
+			continue;
+		}
+		if (CheckpointSeek(index, decoder, targets[i], bytes) == -1)
+		{
+			printf("HuffmanVerify(): %s cannot seek to byte %lld.\n", index->engine->name, targets[i]);
+			return -1;
+		}
+		for (j = targets[i]; j < length && j < targets[i] + 256; j++)
+		{
+			symbol = index->engine->DecoderDecode(decoder);
+			if (symbol != data[j])
+			{
+				printf("HuffmanVerify(): %s decodes byte %d after a seek as %d instead of %d.\n",
+					index->engine->name, j, symbol, data[j]);
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+
+/* decode encoded again with DecoderDecodeMany, in two calls that split the
+ * data unevenly; returns -1 if it does not give back data */
+static int HuffmanVerifyDecodeMany(const HUFFMANENGINE *engine, unsigned char *encoded,
+	unsigned char *data, int length, int weightLimit)
+{
+	unsigned char *output;
+	void *decoder;
+	int first, result = 0;
+
+	if ((output = (unsigned char *) malloc (length + 1)) == NULL)
+	{
+		printf("HuffmanVerify(): fail to allocate buffer.\n");
+		return -1;
+	}
+
+	decoder = engine->DecoderAlloc(encoded, 0);
+	engine->CoderSetWeightLimit(decoder, weightLimit);
+	first = length / 3;
+	if (engine->DecoderDecodeMany(decoder, output, first) != first
+		|| engine->DecoderDecodeMany(decoder, output + first, length - first + 1) != length - first
+		|| memcmp(output, data, length) != 0)
+	{
+		printf("HuffmanVerify(): %s decodes differently many symbols at a time.\n", engine->name);
+		result = -1;
+	}
+	engine->DecoderDealloc(decoder);
+	free(output);
+
+	return result;
+}
+
+
+/* round trip data through engine with a bulk update of k after every fifth
+ * symbol on both sides, k taken from the symbol so the decoder knows it;
+ * k runs past the bulk threshold so both ways of adding it are mixed with
+ * single updates. Returns -1 if the decoder does not give back data */
+static int HuffmanVerifyUpdateBy(const HUFFMANENGINE *engine, void (*updateBy)(void *coder, int symbol, int k),
+	unsigned char *data, int length, int weightLimit)
+{
+	unsigned char *encoded;
+	void *coder;
+	int j, symbol, result = 0;
+
+	if ((encoded = (unsigned char *) malloc (HuffmanEncodeBound(length))) == NULL)
+	{
+		printf("HuffmanVerify(): fail to allocate buffer.\n");
+		return -1;
+	}
+
+	coder = engine->EncoderAlloc(encoded, 0);
+	engine->CoderSetWeightLimit(coder, weightLimit);
+	for (j = 0; j < length; j++)
+	{
+		engine->EncoderEncode(coder, data[j]);
+		if (j % 5 == 0)
+		{
+			updateBy(coder, data[j], 1 + (data[j] + j) % 32);
+		}
+	}
+	engine->EncoderEnd(coder);
+	engine->EncoderFlush(coder);
+	engine->EncoderDealloc(coder);
+
+	coder = engine->DecoderAlloc(encoded, 0);
+	engine->CoderSetWeightLimit(coder, weightLimit);
+	for (j = 0; j < length && result == 0; j++)
+	{
+		if ((symbol = engine->DecoderDecode(coder)) != data[j])
+		{
+			printf("HuffmanVerify(): %s with bulk updates decodes byte %d as %d instead of %d.\n",
+				engine->name, j, symbol, data[j]);
+			result = -1;
+		}
+		else if (j % 5 == 0)
+		{
+			updateBy(coder, data[j], 1 + (data[j] + j) % 32);
+		}
+	}
+	if (result == 0 && length > 0 && (symbol = engine->DecoderDecode(coder)) != HUFFMAN_END)
+	{
+		printf("HuffmanVerify(): %s with bulk updates decodes %d instead of the end.\n", engine->name, symbol);
+		result = -1;
+	}
+	engine->DecoderDealloc(coder);
+	free(encoded);
+
+	return result;
+}
+
+
+/* round trip data through every engine, and check that each stream ends in
+ * its end code, that decoding many symbols at a time agrees, that the
+ * reference engines and their fast versions write the same bits, that
+ * seeking through checkpoints lands on the right bytes and that the fast
+ * engines stay in step through bulk updates; returns -1 on the first failure */
+int HuffmanVerify(unsigned char *data, int length, int weightLimit)
+{
+	static const int pairs[2][2] =
+	{
+		{ HUFFMAN_ENGINE_FGK, HUFFMAN_ENGINE_FGK_FAST },
+		{ HUFFMAN_ENGINE_VITTER, HUFFMAN_ENGINE_VITTER_FAST }
+	};
+	/* bulk updates of the fast engine of each pair */
+	static void (* const updateBy[2])(void *coder, int symbol, int k) =
+	{
+		FGKFASTUpdateBy,
+		VITTERFASTUpdateBy
+	};
+	unsigned char *encoded[HUFFMAN_NUM_ENGINES];
+	long long bytes[HUFFMAN_NUM_ENGINES];
+	const HUFFMANENGINE *engine;
+	CHECKPOINTINDEX *index;
+	void *coder;
+	int i, j, symbol, result = 0;
+
+	for (i = 0; i < HUFFMAN_NUM_ENGINES; i++)
+	{
+		encoded[i] = NULL;
+	}
+
+	for (i = 0; i < HUFFMAN_NUM_ENGINES && result == 0; i++)
+	{
+		engine = &engines[i];
+		if ((encoded[i] = (unsigned char *) malloc (HuffmanEncodeBound(length))) == NULL)
+		{
+			printf("HuffmanVerify(): fail to allocate buffer.\n");
+			result = -1;
+			break;
+		}
+
+		coder = engine->EncoderAlloc(encoded[i], 0);
+		engine->CoderSetWeightLimit(coder, weightLimit);
+		index = NULL;
+		if (engine->EncoderBitsWrite(coder) != -1)
+		{
+			index = CheckpointIndexAlloc(engine, coder, length / 4 + 1);
+		}
+		for (j = 0; j < length && result == 0; j++)
+		{
+			if (index != NULL)
+			{
+				CheckpointIndexAdd(index, coder, j);
+			}
+			if (engine->EncoderEncode(coder, data[j]) == -1)
+			{
+				printf("HuffmanVerify(): %s fails to encode byte %d.\n", engine->name, j);
+				result = -1;
+			}
+		}
+		engine->EncoderEnd(coder);
+		engine->EncoderFlush(coder);
+		bytes[i] = engine->EncoderBytesWrite(coder);
+		engine->EncoderDealloc(coder);
+
+		coder = engine->DecoderAlloc(encoded[i], 0);
+		engine->CoderSetWeightLimit(coder, weightLimit);
+		for (j = 0; j < length && result == 0; j++)
+		{
+			symbol = engine->DecoderDecode(coder);
+			if (symbol != data[j])
+			{
+				printf("HuffmanVerify(): %s decodes byte %d as %d instead of %d.\n",
+					engine->name, j, symbol, data[j]);
+				result = -1;
+				break;
+			}
+		}
+		/* an empty stream has no end code */
+		if (result == 0 && length > 0 && (symbol = engine->DecoderDecode(coder)) != HUFFMAN_END)
+		{
+			printf("HuffmanVerify(): %s decodes %d instead of the end.\n", engine->name, symbol);
+			result = -1;
+		}
+		if (index != NULL && result == 0)
+		{
+			result = HuffmanVerifySeek(index, coder, bytes[i], data, length);
+		}
+		if (result == 0 && length > 0)
+		{
+			result = HuffmanVerifyDecodeMany(engine, encoded[i], data, length, weightLimit);
+		}
+		CheckpointIndexDealloc(index);
+		engine->DecoderDealloc(coder);
+	}
+
+	for (i = 0; i < 2 && result == 0; i++)
+	{
+		if (bytes[pairs[i][0]] != bytes[pairs[i][1]]
+			|| memcmp(encoded[pairs[i][0]], encoded[pairs[i][1]], bytes[pairs[i][0]]) != 0)
+		{
+			printf("HuffmanVerify(): %s and %s write different bits.\n",
+				engines[pairs[i][0]].name, engines[pairs[i][1]].name);
+			result = -1;
+		}
+	}
+
+	for (i = 0; i < 2 && result == 0; i++)
+	{
+		result = HuffmanVerifyUpdateBy(&engines[pairs[i][1]], updateBy[i], data, length, weightLimit);
+	}
+
+	for (i = 0; i < HUFFMAN_NUM_ENGINES; i++)
+	{
+		free(encoded[i]);
+	}
+
+	return result;
+}
+
+
+int HuffmanHeaderWrite(FILE *stream, HUFFMANHEADER *header)
+{
+	unsigned char bytes[HUFFMAN_HEADER_SIZE];
+	int i;
+
+	bytes[0] = HUFFMAN_MAGIC0;
+	bytes[1] = HUFFMAN_MAGIC1;
+	bytes[2] = HUFFMAN_VERSION;
+	bytes[3] = (unsigned char)header->engine;
+	bytes[4] = (unsigned char)(header->weightLimit >> 24);
+	bytes[5] = (unsigned char)(header->weightLimit >> 16);
+	bytes[6] = (unsigned char)(header->weightLimit >> 8);
+	bytes[7] = (unsigned char)header->weightLimit;
+	for (i = 0; i < 8; i++)
+	{
+		bytes[8 + i] = (unsigned char)(header->length >> (56 - 8 * i));
+	}
+	bytes[16] = (unsigned char)(header->blockSize >> 24);
+	bytes[17] = (unsigned char)(header->blockSize >> 16);
+	bytes[18] = (unsigned char)(header->blockSize >> 8);
+	bytes[19] = (unsigned char)header->blockSize;
+
+	if (fwrite(bytes, 1, HUFFMAN_HEADER_SIZE, stream) != HUFFMAN_HEADER_SIZE)
+	{
+		printf("HuffmanHeaderWrite(): fail to write header.\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+
+int HuffmanHeaderRead(FILE *stream, HUFFMANHEADER *header)
+{
+	unsigned char bytes[HUFFMAN_HEADER_SIZE];
+	unsigned long long length;
+	int i;
+
+	if (fread(bytes, 1, HUFFMAN_HEADER_SIZE, stream) != HUFFMAN_HEADER_SIZE)
+	{
+		printf("HuffmanHeaderRead(): fail to read header.\n");
+		return -1;
+	}
+
+	if (bytes[0] != HUFFMAN_MAGIC0 || bytes[1] != HUFFMAN_MAGIC1 || bytes[2] != HUFFMAN_VERSION)
+	{
+		printf("HuffmanHeaderRead(): not a Huffman stream of version %d.\n", HUFFMAN_VERSION);
+		return -1;
+	}
+
+	header->engine = bytes[3];
+	header->weightLimit = (int)(((unsigned int)bytes[4] << 24) | (bytes[5] << 16) | (bytes[6] << 8) | bytes[7]);
+	length = 0;
+	for (i = 0; i < 8; i++)
+	{
+		length = (length << 8) | bytes[8 + i];
+	}
+	header->length = (long long)length;
+	if (header->length < HUFFMAN_LENGTH_UNKNOWN)
+	{
+		printf("HuffmanHeaderRead(): bad length %lld.\n", header->length);
+		return -1;
+	}
+	header->blockSize = (int)(((unsigned int)bytes[16] << 24) | (bytes[17] << 16) | (bytes[18] << 8) | bytes[19]);
+	if (header->blockSize < 0)
+	{
+		printf("HuffmanHeaderRead(): bad block size %d.\n", header->blockSize);
+		return -1;
+	}
+	if (HuffmanEngine(header->engine) == NULL)
+	{
+		printf("HuffmanHeaderRead(): unknown engine %d.\n", header->engine);
+		return -1;
+	}
+
+	return 0;
+}
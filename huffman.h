@@ -12,6 +12,8 @@
 #include "vitter.h"
 #include "fgkFast.h"
 #include "vitterFast.h"
+#include "order1.h"
+#include "rle.h"
 
 
 //#define __USE_FGK__ // FGK
@@ -45,7 +47,7 @@ typedef	FGKFASTDECODER	HUFFMANDECODER;
 #define HuffmanDecoderDecode(decoder) FGKFASTDecoderDecode(decoder)
 #define HuffmanDecoderAlloc(stream, IsFile) FGKFASTDecoderAlloc(stream, IsFile)
 #define HuffmanDecoderDealloc(decoder) FGKFASTDecoderDealloc(decoder)
-#define HuffmanDecoderBytesRead(decoder) FGKDecoderBytesRead(decoder)
+#define HuffmanDecoderBytesRead(decoder) FGKFASTDecoderBytesRead(decoder)
 #endif   
 
 #ifdef __USE_VITTER__ // VITTER
@@ -77,4 +79,76 @@ typedef	VITTERFASTDECODER	HUFFMANDECODER;
 #define HuffmanDecoderBytesRead(decoder) VITTERFASTDecoderBytesRead(decoder)
 #endif 
 
+
+/* runtime engine selection, independent of the compile-time choice above */
+#define HUFFMAN_ENGINE_UNKNOWN      -2
+#define HUFFMAN_ENGINE_AUTO         -1
+#define HUFFMAN_ENGINE_FGK          0
+#define HUFFMAN_ENGINE_FGK_FAST     1
+#define HUFFMAN_ENGINE_VITTER       2
+#define HUFFMAN_ENGINE_VITTER_FAST  3
+#define HUFFMAN_ENGINE_ORDER1       4
+#define HUFFMAN_ENGINE_RLE          5
+#define HUFFMAN_NUM_ENGINES         6
+
+/* auto mode codes this many leading bytes with every engine */
+#define HUFFMAN_AUTO_SAMPLE         65536
+
+/* ratio weight of the auto mode score: 1 = best ratio, 0 = fastest */
+#define HUFFMAN_AUTO_RATIO          1.0
+#define HUFFMAN_AUTO_SPEED          0.0
+#define HUFFMAN_AUTO_WEIGHTED       0.5
+
+#define HUFFMAN_MAGIC0              'A'
+#define HUFFMAN_MAGIC1              'H'
+#define HUFFMAN_VERSION             5
+#define HUFFMAN_HEADER_SIZE         20
+
+/* every engine decodes the end of a stream as this symbol */
+#define HUFFMAN_END                 256
+/* header length of a stream coded before its length was known */
+#define HUFFMAN_LENGTH_UNKNOWN      -1
+
+typedef struct
+{
+	int id;
+	const char *name;
+	void *(*EncoderAlloc)(void *stream, int IsFile);
+	int (*EncoderEncode)(void *encoder, int symbol);	/* -1 if the encoder runs out of memory */
+	void (*EncoderEnd)(void *encoder);	/* marks the end in the stream, before EncoderFlush */
+	void (*EncoderFlush)(void *encoder);
+	void (*EncoderDealloc)(void *encoder);
+	long long (*EncoderBytesWrite)(void *encoder);
+	void *(*DecoderAlloc)(void *stream, int IsFile);
+	int (*DecoderDecode)(void *decoder);	/* HUFFMAN_END at the end of the stream, -1 out of memory */
+	/* up to length symbols into output, fewer only at the end; -1 if corrupt */
+	int (*DecoderDecodeMany)(void *decoder, unsigned char *output, int length);
+	void (*DecoderDealloc)(void *decoder);
+	long long (*DecoderBytesRead)(void *decoder);
+	void (*CoderSetWeightLimit)(void *coder, int weightLimit);
+	const HUFFMANSTATS *(*CoderStats)(void *coder);	/* NULL if the engine keeps none */
+	/* model snapshots and seeking, -1 if the engine has none */
+	int (*CoderSaveState)(void *coder, CODERSTATE *state);
+	int (*CoderLoadState)(void *coder, const CODERSTATE *state);
+	long long (*EncoderBitsWrite)(void *encoder);
+	int (*DecoderSeek)(void *decoder, long long bits, long long length);	/* length of the stream in bytes */
+} HUFFMANENGINE;
+
+typedef struct
+{
+	int engine;
+	int weightLimit;	/* root weight at which all weights are halved, 0 = never */
+	long long length;	/* number of original bytes, or HUFFMAN_LENGTH_UNKNOWN */
+	int blockSize;	/* original bytes per independent block, 0 = one stream */
+} HUFFMANHEADER;
+
+
+const HUFFMANENGINE *HuffmanEngine(int id);
+int HuffmanEngineByName(const char *name);
+int HuffmanEngineAuto(unsigned char *sample, int length, double ratioWeight);
+long long HuffmanEncodeBound(long long length);
+int HuffmanVerify(unsigned char *data, int length, int weightLimit);
+int HuffmanHeaderWrite(FILE *stream, HUFFMANHEADER *header);
+int HuffmanHeaderRead(FILE *stream, HUFFMANHEADER *header);
+
 #endif
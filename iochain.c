@@ -0,0 +1,94 @@
+/*************************************************************************
+ *
+ *	File:	iochain.c
+ *	Author:  Jing Huang & Liang Wu
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include "iochain.h"
+
+
+void IOChainInit(IOCHAIN *chain, struct iovec *buffers, int numBuffers)
+{
+	chain->buffers = buffers;
+	chain->numBuffers = numBuffers;
+	chain->current = 0;
+	chain->offset = 0;
+	chain->overrun = 0;
+}
+
+
+/* step over full or empty buffers; false at the end of the chain */
+static bool IOChainNext(IOCHAIN *chain)
+{
+	while (chain->current < chain->numBuffers
+		&& chain->offset == chain->buffers[chain->current].iov_len)
+	{
+		chain->current++;
+		chain->offset = 0;
+	}
+
+	return chain->current < chain->numBuffers;
+}
+
+
+/* a byte past the last buffer is counted in overrun, which the caller
+ * checks after the flush */
+void IOChainPut(IOCHAIN *chain, int value)
+{
+	if (!IOChainNext(chain))
+	{
+		chain->overrun++;
+		return;
+	}
+
+	((unsigned char *)chain->buffers[chain->current].iov_base)[chain->offset++] = (unsigned char)value;
+}
+
+
+int IOChainGet(IOCHAIN *chain)
+{
+	if (!IOChainNext(chain))
+	{
+		chain->overrun++;
+		return EOF;
+	}
+
+	return ((unsigned char *)chain->buffers[chain->current].iov_base)[chain->offset++];
+}
+
+
+/* bytes written to buffer i */
+size_t IOChainUsed(const IOCHAIN *chain, int i)
+{
+	if (i < chain->current)
+	{
+		return chain->buffers[i].iov_len;
+	}
+	if (i == chain->current && i < chain->numBuffers)
+	{
+		return chain->offset;
+	}
+
+	return 0;
+}
+
+
+/* cut every buffer down to the bytes written to it and return how many
+ * buffers hold any, ready to be handed to writev() */
+int IOChainTrim(IOCHAIN *chain)
+{
+	int i, count = 0;
+
+	for (i = 0; i < chain->numBuffers; i++)
+	{
+		chain->buffers[i].iov_len = IOChainUsed(chain, i);
+		if (chain->buffers[i].iov_len > 0)
+		{
+			count = i + 1;
+		}
+	}
+
+	return count;
+}
@@ -0,0 +1,39 @@
+/*************************************************************************
+ *
+ *	File:	iochain.h
+ *	Author:  Jing Huang & Liang Wu
+ *
+ *	Description: a chain of caller buffers used as a coder stream, for
+ *  coding straight into the buffers given to writev() or decoding
+ *  straight from received chunks. A coder allocated with IsFile ==
+ *  IOCHAIN_STREAM takes an IOCHAIN * as its stream and fills or reads the
+ *  buffers in order, codewords running across buffer ends. A decoder
+ *  keeps its place in the chain, so chunks arriving later can be added
+ *  by raising numBuffers before the decoder gets to them.
+ *
+ ************************************************************************/
+
+#ifndef __IOCHAIN_H_
+#define __IOCHAIN_H_
+
+#include <stdbool.h>
+#include <sys/uio.h>
+
+#define IOCHAIN_STREAM       2	/* IsFile value of a coder on an IOCHAIN */
+
+typedef struct
+{
+	struct iovec *buffers;
+	int numBuffers;
+	int current;	/* buffer being filled */
+	size_t offset;	/* bytes already in it */
+	long long overrun;	/* bytes past the last buffer: dropped when writing, read as EOF */
+}IOCHAIN;
+
+void IOChainInit(IOCHAIN *chain, struct iovec *buffers, int numBuffers);
+void IOChainPut(IOCHAIN *chain, int value);
+int IOChainGet(IOCHAIN *chain);
+size_t IOChainUsed(const IOCHAIN *chain, int i);
+int IOChainTrim(IOCHAIN *chain);
+
+#endif
@@ -4,196 +4,299 @@
  *	Author:  Jing Huang & Liang Wu
  *
  *
- *	Description: example compressors trying to compress files with
- *  adaptive Huffman coding.
+ *	Description: command-line compressor with adaptive Huffman coding.
+ *  Built with:
+ *
+ *    gcc -O2 -o huffman main.c batch.c block.c huffman.c fgk.c fgkFast.c \
+ *        vitter.c vitterFast.c order1.c rle.c stats.c state.c checkpoint.c \
+ *        iochain.c timer.c perf.c -lpthread
+ *
+ *  Each file is compressed to file.ah (decompressed from file.ah to
+ *  file), the original is kept. With no file, or "-", stdin is coded
+ *  onto stdout. Exits with 0 when every input was coded, 1 when some
+ *  failed and 2 on a bad command line.
+ *
+ *  -v ends with the time spent reading, coding and writing; built with
+ *  -DHUFFMAN_PROFILE that includes the steps inside the fast engines, and
+ *  built with -DHUFFMAN_STATS each encoder also prints its counters.
  *
  ************************************************************************/
 
+#define _FILE_OFFSET_BITS 64
+
 #include <stdio.h>
 #include <stdlib.h>
-#include <stdarg.h>
-#include <sys/stat.h>
+#include <string.h>
+#include <unistd.h>
 #include <stdbool.h>
 #include "huffman.h"
+#include "batch.h"
 #include "timer.h"
 
-int encodedFileLength;
+#define EXIT_OK      0
+#define EXIT_FAILED  1	/* some input could not be coded */
+#define EXIT_USAGE   2
+
+
+static void Usage(FILE *stream, const char *program)
+{
+	fprintf(stream,
+		"usage: %s [-d] [-e engine] [-w limit] [-B size] [-T threads] [-v] [--bench] [file...]\n"
+		"  -d          decompress file.ah to file\n"
+		"  -e engine   fgk, fgkfast, vitter, vitterfast, order1, rle or auto (default)\n"
+		"  -w limit    halve all weights whenever the root reaches limit (0 = never)\n"
+		"  -B size     code independent blocks of size bytes, decoded in parallel\n"
+		"  -T threads  files coded at once, and threads per block stream (0 = all processors)\n"
+		"  -v          one line per file on stderr, then where the time went\n"
+		"  --bench     round trip each file through temporary files and report the speed\n"
+		"with no file, or -, stdin is coded onto stdout.\n", program);
+}
 
-/* create an input buffer for faster I/O */
-#define IN_BUFSIZE 16384
-unsigned char input_buf[ IN_BUFSIZE ];
-unsigned int nread = 0, in_i = 0;
 
-int GetFileLength(char *FileName)
+static bool ParseNumber(const char *text, int *value)
 {
-	struct stat statistics;
+	char *end;
+	long number = strtol(text, &end, 10);
 
-	if (stat(FileName, &statistics) == -1) return 0;
+	if (*text == '\0' || *end != '\0' || number < 0 || number > 0x7fffffff)
+	{
+		return false;
+	}
+	*value = (int)number;
 
-	return (int)statistics.st_size;
+	return true;
 }
 
 
-void Enc(void)
+/* code stdin onto stdout */
+static int Stream(const BATCHOPTIONS *options)
 {
-	double WriteBytes, ReadBytes = 0;
-	int symbol;
-	double duration;
-	char InFileName[50] = "D:\\SJSU\\c++program\\tt\\AdaptiveHuffmanCoding\\061";
-	char OutFileName[50] = "D:\\SJSU\\c++program\\tt\\AdaptiveHuffmanCoding\\a";
-	FILE *InFile, *OutFile;
-	HUFFMANENCODER *HuffmanCoder;
+	HUFFMANHEADER header;
+	FILE *out;
+	long long WriteBytes = 0;
+	int result;
 
-	encodedFileLength = GetFileLength(InFileName);
+	if (!options->decompress && isatty(STDOUT_FILENO))
+	{
+		fprintf(stderr, "compressed data not written to a terminal, see -h.\n");
+		return EXIT_USAGE;
+	}
 
-	printf("Huffman Encoder 1.0 \n");
+	/* the coders report errors on stdout, so the data gets its own copy of
+	 * stdout and stdout itself becomes stderr */
+	if ((out = fdopen(dup(STDOUT_FILENO), "wb")) == NULL)
+	{
+		fprintf(stderr, "fail to open stdout.\n");
+		return EXIT_FAILED;
+	}
+	fflush(stdout);
+	dup2(STDERR_FILENO, STDOUT_FILENO);
+	setvbuf(stdin, NULL, _IOFBF, BATCH_BUFSIZE);
+	setvbuf(out, NULL, _IOFBF, BATCH_BUFSIZE);
 
-	if ((InFile = fopen(InFileName, "rb")) == NULL)
+	if (options->decompress)
+	{
+		result = BatchDecompressStream(stdin, out, options, &header);
+	}
+	else
+	{
+		result = (WriteBytes = BatchCompressStream(stdin, out, options, &header)) == -1 ? -1 : 0;
+	}
+	if (fclose(out) != 0 && result == 0)
 	{
-		printf("fail to open file %s.\n", InFileName);
-		exit(1);
+		fprintf(stderr, "fail to write stdout.\n");
+		result = -1;
 	}
 
-	if ((OutFile = fopen(OutFileName, "wb")) == NULL)
+	if (result == 0 && options->verbose && options->decompress)
 	{
-		printf("fail to open file %s.\n", OutFileName);
-		exit(1);
+		fprintf(stderr, "-: %s, %lld bytes\n", HuffmanEngine(header.engine)->name, header.length);
 	}
+	else if (result == 0 && options->verbose)
+	{
+		fprintf(stderr, "-: %s, %lld -> %lld bytes\n", HuffmanEngine(header.engine)->name,
+			header.length, WriteBytes);
+	}
+
+	return result == 0 ? EXIT_OK : EXIT_FAILED;
+}
 
 
-	HuffmanCoder = HuffmanEncoderAlloc(OutFile, 1);
+/* true when both streams hold the same bytes from where they are */
+static bool SameBytes(FILE *a, FILE *b)
+{
+	static unsigned char bufferA[BATCH_BUFSIZE], bufferB[BATCH_BUFSIZE];
+	size_t n;
 
-	StartTimer();
-	/*for ( ; ; )
+	do
 	{
-		symbol = getc(InFile);
+		n = fread(bufferA, 1, BATCH_BUFSIZE, a);
+		if (fread(bufferB, 1, BATCH_BUFSIZE, b) != n || memcmp(bufferA, bufferB, n) != 0)
+		{
+			return false;
+		}
+	}while (n == BATCH_BUFSIZE);
+
+	return true;
+}
+
+
+/* compress each file into a temporary file, decompress that into another,
+ * check the result and report sizes and speeds; returns the failures */
+static int Bench(char **names, int numNames, const BATCHOPTIONS *options)
+{
+	HUFFMANHEADER header;
+	FILE *InFile, *encoded, *decoded;
+	double encodeSeconds, decodeSeconds, start;
+	long long WriteBytes;
+	int i, failed = 0;
 
-		if (symbol != EOF)
+	for (i = 0; i < numNames; i++)
+	{
+		if ((InFile = fopen(names[i], "rb")) == NULL)
 		{
-			HuffmanEncoderEncode(HuffmanCoder, symbol);
+			fprintf(stderr, "fail to open file %s.\n", names[i]);
+			failed++;
+			continue;
 		}
-		else
+		if ((encoded = tmpfile()) == NULL || (decoded = tmpfile()) == NULL)
 		{
-			//HuffmanEncoderEncode(HuffmanCoder, EndSymbol);
-			break;
+			fprintf(stderr, "fail to create temporary files.\n");
+			exit(EXIT_FAILED);
 		}
+		setvbuf(InFile, NULL, _IOFBF, BATCH_BUFSIZE);
+		setvbuf(encoded, NULL, _IOFBF, BATCH_BUFSIZE);
+		setvbuf(decoded, NULL, _IOFBF, BATCH_BUFSIZE);
 
-		ReadBytes += 1;
-	}*/
+		start = TimerNow();
+		WriteBytes = BatchCompressStream(InFile, encoded, options, &header);
+		encodeSeconds = TimerNow() - start;
 
+		rewind(encoded);
+		start = TimerNow();
+		if (WriteBytes == -1 || BatchDecompressStream(encoded, decoded, options, &header) == -1)
+		{
+			fprintf(stderr, "%s: fail to code.\n", names[i]);
+			failed++;
+		}
+		else
+		{
+			decodeSeconds = TimerNow() - start;
 
-	while( true )
-	{
-		/* load the input buffer. */
-		nread = fread( input_buf, 1, IN_BUFSIZE, InFile);
-		if ( nread == 0 ) break;
-		in_i = 0;
-	
-		/* get bytes from the buffer and compress them. */
-		while( in_i < nread )
-		{
-			symbol = (unsigned char) *(input_buf + in_i);
-			++in_i;
-			if (symbol != EOF)
+			rewind(InFile);
+			rewind(decoded);
+			if (!SameBytes(InFile, decoded))
 			{
-				HuffmanEncoderEncode(HuffmanCoder, symbol);
+				fprintf(stderr, "%s: round trip differs.\n", names[i]);
+				failed++;
 			}
 			else
 			{
-				//HuffmanEncoderEncode(HuffmanCoder, EndSymbol);
-				break;
+				printf("%s: %s, %lld -> %lld bytes (%.2f%%), encode %.1f MB/s, decode %.1f MB/s\n",
+					names[i], HuffmanEngine(header.engine)->name, header.length, WriteBytes,
+					header.length > 0 ? 100.0 * WriteBytes / header.length : 0.0,
+					header.length / 1e6 / (encodeSeconds > 0 ? encodeSeconds : 1e-9),
+					header.length / 1e6 / (decodeSeconds > 0 ? decodeSeconds : 1e-9));
 			}
-	
-			ReadBytes += 1;
 		}
-	}
-	HuffmanEncoderFlush(HuffmanCoder);
-
-	StopTimer();
-	duration = ElapsedTime();
-	printf("Encode time: %lf\n", duration);
-
-
-	printf("ReadBytes : %d (%.3fk)\n", (int)ReadBytes, ReadBytes / 1024);
-	WriteBytes = HuffmanEncoderBytesWrite(HuffmanCoder);
-	printf("WriteBytes: %d (%.3fk)\n", (int)WriteBytes, WriteBytes / 1024);
-	printf("compression ratio: %.2f%%\n", (double) WriteBytes / ReadBytes * 100);
-	//printf("compression ratio: %.2f%%\n", (1 - WriteBytes / ReadBytes) * 100);
 
-	HuffmanEncoderDealloc(HuffmanCoder);
-
-	fclose(InFile);
-	fclose(OutFile);
+		fclose(decoded);
+		fclose(encoded);
+		fclose(InFile);
+	}
 
-	printf("done.\n\n");
+	return failed;
 }
 
 
-void Dec(void)
+int main(int argc, char **argv)
 {
-	int symbol;
-	int length, count;
-	double duration;
-	char InFileName[50] = "D:\\SJSU\\c++program\\tt\\AdaptiveHuffmanCoding\\a";
-	char OutFileName[50] = "D:\\SJSU\\c++program\\tt\\AdaptiveHuffmanCoding\\062";
-	FILE *InFile, *OutFile;
-	HUFFMANDECODER *HuffmanDecoder;
-
-	printf("Huffman Decoder 1.0 \n");
-
-	length = GetFileLength(InFileName);
-	if ((InFile = fopen(InFileName, "rb")) == NULL)
-	{
-		printf("fail to open file %s.\n", InFileName);
-		exit(1);
-	}
-
-	if ((OutFile = fopen(OutFileName, "wb")) == NULL)
-	{
-		printf("fail to open file %s.\n", OutFileName);
-		exit(1);
-	}
-
-
-	count = 0;
-
-	HuffmanDecoder = HuffmanDecoderAlloc(InFile, 1);
-
-	StartTimer();
-	for ( ; ; )
+	BATCHOPTIONS options;
+	bool bench = false;
+	int c, result;
+
+	options.engine = HUFFMAN_ENGINE_AUTO;
+	options.weightLimit = 0;
+	options.blockSize = 0;
+	options.threads = 0;
+	options.decompress = false;
+	options.verbose = false;
+
+	for (c = 1; c < argc && argv[c][0] == '-' && argv[c][1] != '\0'; c++)
 	{
-		symbol = HuffmanDecoderDecode(HuffmanDecoder);
-		count++;
-		putc(symbol, OutFile);
-
-		/*if (FGKDecoderBytesRead(HuffmanDecoder) == length )
+		if (strcmp(argv[c], "--") == 0)
 		{
+			c++;
 			break;
-		}*/
-		if(count == encodedFileLength)
+		}
+		else if (strcmp(argv[c], "-d") == 0)
 		{
-			break;
+			options.decompress = true;
+		}
+		else if (strcmp(argv[c], "-v") == 0)
+		{
+			options.verbose = true;
+		}
+		else if (strcmp(argv[c], "--bench") == 0)
+		{
+			bench = true;
+		}
+		else if (strcmp(argv[c], "-h") == 0 || strcmp(argv[c], "--help") == 0)
+		{
+			Usage(stdout, argv[0]);
+			return EXIT_OK;
+		}
+		else if (strcmp(argv[c], "-e") == 0 && c + 1 < argc)
+		{
+			options.engine = HuffmanEngineByName(argv[++c]);
+			if (options.engine == HUFFMAN_ENGINE_UNKNOWN)
+			{
+				fprintf(stderr, "unknown engine %s.\n", argv[c]);
+				return EXIT_USAGE;
+			}
+		}
+		else if (strcmp(argv[c], "-w") == 0 && c + 1 < argc && ParseNumber(argv[c + 1], &options.weightLimit))
+		{
+			c++;
+		}
+		else if (strcmp(argv[c], "-B") == 0 && c + 1 < argc && ParseNumber(argv[c + 1], &options.blockSize))
+		{
+			c++;
+		}
+		else if (strcmp(argv[c], "-T") == 0 && c + 1 < argc && ParseNumber(argv[c + 1], &options.threads))
+		{
+			c++;
+		}
+		else
+		{
+			Usage(stderr, argv[0]);
+			return EXIT_USAGE;
 		}
 	}
 
-	StopTimer();
-	duration = ElapsedTime();
-	printf("Decode time: %lf\n", duration);
-
-
-	HuffmanDecoderDealloc(HuffmanDecoder);
-
-	fclose(InFile);
-	fclose(OutFile);
-
-	printf("done.\n\n");
-}
-
+	if (bench)
+	{
+		if (c == argc)
+		{
+			fprintf(stderr, "--bench needs files.\n");
+			return EXIT_USAGE;
+		}
+		result = Bench(argv + c, argc - c, &options) ? EXIT_FAILED : EXIT_OK;
+	}
+	else if (c == argc || (c + 1 == argc && strcmp(argv[c], "-") == 0))
+	{
+		result = Stream(&options);
+	}
+	else
+	{
+		result = BatchRun(argv + c, argc - c, &options) ? EXIT_FAILED : EXIT_OK;
+	}
 
-int main(int argc, char **argv)
-{
-	Enc();
-	Dec();
+	/* reading, coding and writing, and with HUFFMAN_PROFILE the engine steps */
+	if (options.verbose)
+	{
+		TimerReport(stderr);
+	}
 
-	return 0;
+	return result;
 }
@@ -0,0 +1,235 @@
+/*************************************************************************
+ *
+ *	File:	order1.c
+ *	Author:  Jing Huang & Liang Wu
+ *
+ *	Description: order-1 adaptive Huffman coding. The previous symbol
+ *  selects a context tree; a symbol new to its context is sent as the
+ *  context's zero node code followed by its order-0 code.
+ *
+ ************************************************************************/
+
+#include "order1.h"
+
+
+static ORDER1CODER *ORDER1CoderAlloc(FGKFASTCODER *order0)
+{
+	ORDER1CODER *coder;
+	int i;
+
+	if (order0 == NULL)
+	{
+		return NULL;
+	}
+
+	if ((coder = (ORDER1CODER *) malloc (sizeof(ORDER1CODER))) == NULL)
+	{
+		printf("ORDER1CoderAlloc(): fail to allocate ORDER1 coder.\n");
+		FGKFASTEncoderDealloc(order0);
+		return NULL;
+	}
+
+	if ((coder->arena = FGKFASTArenaAlloc()) == NULL)
+	{
+		FGKFASTEncoderDealloc(order0);
+		free(coder);
+		return NULL;
+	}
+
+	coder->order0 = order0;
+	coder->previous = -1;
+	coder->weightLimit = 0;
+	for (i = 0; i < ORDER1_NUM_CONTEXTS; i++)
+	{
+		coder->context[i] = NULL;
+	}
+
+	return coder;
+}
+
+static void ORDER1CoderDealloc(ORDER1CODER *coder)
+{
+	int i;
+
+	if (coder == NULL) return;
+	for (i = 0; i < ORDER1_NUM_CONTEXTS; i++)
+	{
+		FGKFASTCoderDealloc(coder->context[i]);
+	}
+	FGKFASTArenaDealloc(coder->arena);
+	FGKFASTEncoderDealloc(coder->order0);
+	free(coder);
+}
+
+/* context tree of the previous symbol into *context, NULL before the first
+ * symbol; a context used for the first time is allocated and *isNew set.
+ * Returns -1 if it cannot be allocated */
+static int ORDER1Context(ORDER1CODER *coder, FGKFASTCODER **context, bool *isNew)
+{
+	*context = NULL;
+	*isNew = false;
+	if (coder->previous < 0)
+	{
+		return 0;
+	}
+
+	*context = coder->context[coder->previous];
+	if (*context == NULL)
+	{
+		if ((*context = FGKFASTCoderAllocShared(coder->order0, coder->arena)) == NULL)
+		{
+			printf("ORDER1Context(): fail to allocate context %d.\n", coder->previous);
+			return -1;
+		}
+		FGKFASTCoderSetWeightLimit(*context, coder->weightLimit);
+		coder->context[coder->previous] = *context;
+		*isNew = true;
+	}
+
+	return 0;
+}
+
+
+ORDER1ENCODER *ORDER1EncoderAlloc(void *stream, int IsFile)
+{
+	return ORDER1CoderAlloc(FGKFASTEncoderAlloc(stream, IsFile));
+}
+
+/* returns -1 if the context of the symbol cannot be allocated */
+int ORDER1EncoderEncode(ORDER1ENCODER *encoder, int symbol)
+{
+	FGKFASTCODER *context;
+	bool isNew;
+
+	if (ORDER1Context(encoder, &context, &isNew) == -1)
+	{
+		return -1;
+	}
+	if (context == NULL)
+	{
+		FGKFASTEncoderEncode(encoder->order0, symbol);
+	}
+	else if (isNew)
+	{
+		/* both sides know the context is empty, so no escape is sent */
+		FGKFASTEncoderEncode(encoder->order0, symbol);
+		FGKFASTCoderUpdate(context, symbol);
+	}
+	else if (FGKFASTCoderHasSymbol(context, symbol))
+	{
+		FGKFASTEncoderEncode(context, symbol);
+	}
+	else
+	{
+		/* escape through the context's zero node, then code in order 0 */
+		FGKFASTEncoderEncode(context, symbol);
+		FGKFASTEncoderEncode(encoder->order0, symbol);
+	}
+
+	encoder->previous = symbol;
+
+	return 0;
+}
+
+/* the end goes out through order 0, escaping from the context first if
+ * the decoder will be reading the context; a context not used yet is new
+ * to the decoder too, so it is not allocated just for the end */
+void ORDER1EncoderEnd(ORDER1ENCODER *encoder)
+{
+	if (encoder->previous >= 0 && encoder->context[encoder->previous] != NULL)
+	{
+		FGKFASTEncoderEnd(encoder->context[encoder->previous]);
+	}
+	FGKFASTEncoderEnd(encoder->order0);
+}
+
+void ORDER1EncoderFlush(ORDER1ENCODER *encoder)
+{
+	FGKFASTEncoderFlush(encoder->order0);
+}
+
+void ORDER1EncoderDealloc(ORDER1ENCODER *encoder)
+{
+	ORDER1CoderDealloc(encoder);
+}
+
+long long ORDER1EncoderBytesWrite(ORDER1ENCODER *encoder)
+{
+	return FGKFASTEncoderBytesWrite(encoder->order0);
+}
+
+
+ORDER1DECODER *ORDER1DecoderAlloc(void *stream, int IsFile)
+{
+	return ORDER1CoderAlloc(FGKFASTDecoderAlloc(stream, IsFile));
+}
+
+/* returns -1 if the context of the symbol cannot be allocated */
+int ORDER1DecoderDecode(ORDER1DECODER *decoder)
+{
+	FGKFASTCODER *context;
+	bool isNew;
+	int symbol;
+
+	if (ORDER1Context(decoder, &context, &isNew) == -1)
+	{
+		return -1;
+	}
+	if (context == NULL)
+	{
+		symbol = FGKFASTDecoderDecode(decoder->order0);
+	}
+	else if (isNew)
+	{
+		symbol = FGKFASTDecoderDecode(decoder->order0);
+		if (symbol == FGKFAST_END)
+		{
+			return symbol;
+		}
+		FGKFASTCoderUpdate(context, symbol);
+	}
+	else
+	{
+		symbol = FGKFASTDecoderDecode(context);
+		if (symbol == FGKFAST_ESCAPE)
+		{
+			symbol = FGKFASTDecoderDecode(decoder->order0);
+			if (symbol == FGKFAST_END)
+			{
+				return symbol;
+			}
+			FGKFASTCoderUpdate(context, symbol);
+		}
+	}
+
+	decoder->previous = symbol;
+
+	return symbol;
+}
+
+void ORDER1DecoderDealloc(ORDER1DECODER *decoder)
+{
+	ORDER1CoderDealloc(decoder);
+}
+
+long long ORDER1DecoderBytesRead(ORDER1DECODER *decoder)
+{
+	return FGKFASTDecoderBytesRead(decoder->order0);
+}
+
+
+/* the limit applies to the order-0 tree and every context tree */
+void ORDER1CoderSetWeightLimit(ORDER1CODER *coder, int weightLimit)
+{
+	int i;
+
+	coder->weightLimit = weightLimit;
+	FGKFASTCoderSetWeightLimit(coder->order0, weightLimit);
+	for (i = 0; i < ORDER1_NUM_CONTEXTS; i++)
+	{
+		if (coder->context[i] != NULL)
+		{
+			FGKFASTCoderSetWeightLimit(coder->context[i], weightLimit);
+		}
+	}
+}
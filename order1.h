@@ -0,0 +1,39 @@
+/*************************************************************************
+ *
+ *	File:	order1.h
+ *	Author:  Jing Huang & Liang Wu
+ *
+ *	Description: order-1 adaptive Huffman coding, one FGKFAST tree per
+ *  previous symbol with an escape to a shared order-0 tree.
+ *
+ ************************************************************************/
+
+#ifndef __ORDER1_H_
+#define __ORDER1_H_
+
+#include "fgkFast.h"
+
+#define ORDER1_NUM_CONTEXTS  256
+
+typedef struct 
+{
+	FGKFASTCODER *order0;	/* owns the bit stream, codes unseen contexts and escapes */
+	FGKFASTCODER *context[ORDER1_NUM_CONTEXTS];	/* allocated on the first use of a context */
+	FGKFASTARENA *arena;	/* nodes of all context trees */
+	int previous;	/* last symbol, -1 before the first */
+	int weightLimit;
+}ORDER1ENCODER, ORDER1DECODER, ORDER1CODER;
+
+void ORDER1EncoderFlush(ORDER1ENCODER *encoder);
+int ORDER1EncoderEncode(ORDER1ENCODER *encoder, int symbol);
+void ORDER1EncoderEnd(ORDER1ENCODER *encoder);
+ORDER1ENCODER *ORDER1EncoderAlloc(void *stream, int IsFile);
+void ORDER1EncoderDealloc(ORDER1ENCODER *encoder);
+long long ORDER1EncoderBytesWrite(ORDER1ENCODER *encoder);
+int ORDER1DecoderDecode(ORDER1DECODER *decoder);
+ORDER1DECODER *ORDER1DecoderAlloc(void *stream, int IsFile);
+void ORDER1DecoderDealloc(ORDER1DECODER *decoder);
+long long ORDER1DecoderBytesRead(ORDER1DECODER *decoder);
+void ORDER1CoderSetWeightLimit(ORDER1CODER *coder, int weightLimit);
+
+#endif
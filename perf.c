@@ -0,0 +1,170 @@
+/*************************************************************************
+ *
+ *	File:	perf.c
+ *	Author:  Jing Huang & Liang Wu
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "perf.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+
+const char *perfEventNames[PERF_NUM_EVENTS] =
+{
+	"cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses"
+};
+
+
+#ifdef __linux__
+
+static const unsigned int perfTypes[PERF_NUM_EVENTS] =
+{
+	PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE
+};
+
+static const unsigned long long perfConfigs[PERF_NUM_EVENTS] =
+{
+	PERF_COUNT_HW_CPU_CYCLES,
+	PERF_COUNT_HW_INSTRUCTIONS,
+	PERF_COUNT_HW_BRANCH_MISSES,
+	PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+	PERF_COUNT_HW_CACHE_MISSES
+};
+
+
+/* opens what the kernel allows for this thread, user space only;
+ * returns the number of counters opened */
+int PerfOpen(PERFCOUNTERS *counters)
+{
+	struct perf_event_attr attr;
+	int i, opened = 0;
+
+	for (i = 0; i < PERF_NUM_EVENTS; i++)
+	{
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = perfTypes[i];
+		attr.config = perfConfigs[i];
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		/* the kernel multiplexes when there are too few hardware counters */
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		counters->fd[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		if (counters->fd[i] >= 0)
+		{
+			opened++;
+		}
+		else
+		{
+			counters->fd[i] = -1;
+		}
+	}
+	PerfReset(counters);
+
+	return opened;
+}
+
+
+void PerfReset(PERFCOUNTERS *counters)
+{
+	int i;
+
+	for (i = 0; i < PERF_NUM_EVENTS; i++)
+	{
+		counters->value[i] = (counters->fd[i] >= 0) ? 0 : -1;
+	}
+}
+
+
+void PerfStart(PERFCOUNTERS *counters)
+{
+	int i;
+
+	for (i = 0; i < PERF_NUM_EVENTS; i++)
+	{
+		if (counters->fd[i] >= 0)
+		{
+			ioctl(counters->fd[i], PERF_EVENT_IOC_RESET, 0);
+			ioctl(counters->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+}
+
+
+void PerfStop(PERFCOUNTERS *counters)
+{
+	unsigned long long data[3];	/* value, time enabled, time running */
+	int i;
+
+	for (i = 0; i < PERF_NUM_EVENTS; i++)
+	{
+		if (counters->fd[i] < 0) continue;
+
+		ioctl(counters->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+		if (read(counters->fd[i], data, sizeof(data)) != sizeof(data))
+		{
+			continue;
+		}
+		if (data[2] > 0 && data[2] < data[1])
+		{
+			data[0] = (unsigned long long)((double)data[0] * data[1] / data[2]);
+		}
+		counters->value[i] += (long long)data[0];
+	}
+}
+
+
+void PerfClose(PERFCOUNTERS *counters)
+{
+	int i;
+
+	for (i = 0; i < PERF_NUM_EVENTS; i++)
+	{
+		if (counters->fd[i] >= 0)
+		{
+			close(counters->fd[i]);
+			counters->fd[i] = -1;
+		}
+	}
+}
+
+#else
+
+int PerfOpen(PERFCOUNTERS *counters)
+{
+	int i;
+
+	for (i = 0; i < PERF_NUM_EVENTS; i++)
+	{
+		counters->fd[i] = -1;
+	}
+	PerfReset(counters);
+
+	return 0;
+}
+
+void PerfReset(PERFCOUNTERS *counters)
+{
+	int i;
+
+	for (i = 0; i < PERF_NUM_EVENTS; i++)
+	{
+		counters->value[i] = -1;
+	}
+}
+
+void PerfStart(PERFCOUNTERS *counters) { }
+void PerfStop(PERFCOUNTERS *counters) { }
+void PerfClose(PERFCOUNTERS *counters) { }
+
+#endif
@@ -0,0 +1,37 @@
+/*************************************************************************
+ *
+ *	File:	perf.h
+ *	Author:  Jing Huang & Liang Wu
+ *
+ *	Description: hardware counters through perf_event_open on Linux.
+ *  Counters the kernel refuses are left closed and read as -1.
+ *
+ ************************************************************************/
+
+#ifndef __PERF_H_
+#define __PERF_H_
+
+#include <stdbool.h>
+
+#define PERF_CYCLES          0
+#define PERF_INSTRUCTIONS    1
+#define PERF_BRANCH_MISSES   2
+#define PERF_L1D_MISSES      3
+#define PERF_LLC_MISSES      4
+#define PERF_NUM_EVENTS      5
+
+typedef struct
+{
+	int fd[PERF_NUM_EVENTS];	/* -1 if not available */
+	long long value[PERF_NUM_EVENTS];	/* summed over start/stop pairs */
+}PERFCOUNTERS;
+
+extern const char *perfEventNames[PERF_NUM_EVENTS];
+
+int PerfOpen(PERFCOUNTERS *counters);
+void PerfReset(PERFCOUNTERS *counters);
+void PerfStart(PERFCOUNTERS *counters);
+void PerfStop(PERFCOUNTERS *counters);
+void PerfClose(PERFCOUNTERS *counters);
+
+#endif
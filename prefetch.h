@@ -0,0 +1,21 @@
+/*************************************************************************
+ *
+ *	File:	prefetch.h
+ *	Author:  Jing Huang & Liang Wu
+ *
+ *	Description: cache prefetch hint for the tree updates; define
+ *  HUFFMAN_NO_PREFETCH to compare against plain loads.
+ *
+ ************************************************************************/
+
+#ifndef __PREFETCH_H_
+#define __PREFETCH_H_
+
+#if defined(__GNUC__) && !defined(HUFFMAN_NO_PREFETCH)
+/* the update writes what it reads, so ask for the line in write mode */
+#define HUFFMAN_PREFETCH(address) __builtin_prefetch((address), 1, 3)
+#else
+#define HUFFMAN_PREFETCH(address) ((void)(address))
+#endif
+
+#endif
@@ -0,0 +1,223 @@
+/*************************************************************************
+ *
+ *	File:	rle.c
+ *	Author:  Jing Huang & Liang Wu
+ *
+ *	Description: run-length pre-stage in front of FGKFAST coding. A run
+ *  of n equal symbols costs RLE_THRESHOLD symbol updates plus at most four
+ *  count updates instead of n tree updates.
+ *
+ ************************************************************************/
+
+#include "rle.h"
+
+
+static RLECODER *RLECoderAlloc(FGKFASTCODER *symbols)
+{
+	RLECODER *coder;
+
+	if (symbols == NULL)
+	{
+		return NULL;
+	}
+
+	if ((coder = (RLECODER *) malloc (sizeof(RLECODER))) == NULL)
+	{
+		printf("RLECoderAlloc(): fail to allocate RLE coder.\n");
+		FGKFASTEncoderDealloc(symbols);
+		return NULL;
+	}
+
+	if ((coder->counts = FGKFASTCoderAllocShared(symbols, NULL)) == NULL)
+	{
+		FGKFASTEncoderDealloc(symbols);
+		free(coder);
+		return NULL;
+	}
+	/* counts are a plain byte alphabet: new ones follow the zero node code */
+	coder->counts->rawSymbols = true;
+
+	coder->symbols = symbols;
+	coder->previous = -1;
+	coder->equal = 0;
+	coder->run = 0;
+
+	return coder;
+}
+
+static void RLECoderDealloc(RLECODER *coder)
+{
+	if (coder == NULL) return;
+	FGKFASTCoderDealloc(coder->counts);
+	FGKFASTEncoderDealloc(coder->symbols);
+	free(coder);
+}
+
+/* count equal symbols in a row, returns true once the threshold is reached */
+static bool RLECoderCount(RLECODER *coder, int symbol)
+{
+	if (symbol == coder->previous)
+	{
+		coder->equal++;
+	}
+	else
+	{
+		coder->previous = symbol;
+		coder->equal = 1;
+	}
+
+	return coder->equal == RLE_THRESHOLD;
+}
+
+
+RLEENCODER *RLEEncoderAlloc(void *stream, int IsFile)
+{
+	return RLECoderAlloc(FGKFASTEncoderAlloc(stream, IsFile));
+}
+
+/* send the held back run, as one count or as its length in bytes and
+ * the bytes themselves */
+static void RLEEncoderEndRun(RLEENCODER *encoder)
+{
+	int run = encoder->run, bytes;
+
+	if (run < RLE_LONG_COUNT)
+	{
+		FGKFASTEncoderEncode(encoder->counts, run);
+	}
+	else
+	{
+		for (bytes = 1; (run >> (8 * bytes)) != 0; bytes++)
+		{
+		}
+		FGKFASTEncoderEncode(encoder->counts, RLE_LONG_COUNT + bytes - 1);
+		for ( ; bytes > 0; bytes--, run >>= 8)
+		{
+			FGKFASTEncoderEncode(encoder->counts, run & 0xff);
+		}
+	}
+	encoder->run = 0;
+	encoder->equal = 0;
+}
+
+void RLEEncoderEncode(RLEENCODER *encoder, int symbol)
+{
+	if (encoder->equal == RLE_THRESHOLD)
+	{
+		if (symbol == encoder->previous)
+		{
+			if (++encoder->run == RLE_MAX_RUN)
+			{
+				RLEEncoderEndRun(encoder);
+			}
+			return;
+		}
+		RLEEncoderEndRun(encoder);
+	}
+
+	FGKFASTEncoderEncode(encoder->symbols, symbol);
+	RLECoderCount(encoder, symbol);
+}
+
+void RLEEncoderEnd(RLEENCODER *encoder)
+{
+	/* the decoder reads a count right after the threshold symbol */
+	if (encoder->equal == RLE_THRESHOLD)
+	{
+		RLEEncoderEndRun(encoder);
+	}
+	FGKFASTEncoderEnd(encoder->symbols);
+}
+
+void RLEEncoderFlush(RLEENCODER *encoder)
+{
+	/* the decoder reads a count right after the threshold symbol */
+	if (encoder->equal == RLE_THRESHOLD)
+	{
+		RLEEncoderEndRun(encoder);
+	}
+	FGKFASTEncoderFlush(encoder->symbols);
+}
+
+void RLEEncoderDealloc(RLEENCODER *encoder)
+{
+	RLECoderDealloc(encoder);
+}
+
+long long RLEEncoderBytesWrite(RLEENCODER *encoder)
+{
+	return FGKFASTEncoderBytesWrite(encoder->symbols);
+}
+
+
+RLEDECODER *RLEDecoderAlloc(void *stream, int IsFile)
+{
+	return RLECoderAlloc(FGKFASTDecoderAlloc(stream, IsFile));
+}
+
+/* read a run sent by RLEEncoderEndRun(); a corrupt stream may end it early */
+static int RLEDecoderRun(RLEDECODER *decoder)
+{
+	int count, bytes, digit, i;
+
+	count = FGKFASTDecoderDecode(decoder->counts);
+	if (count < RLE_LONG_COUNT || count > 0xff)
+	{
+		return count;
+	}
+
+	bytes = count - RLE_LONG_COUNT + 1;
+	count = 0;
+	for (i = 0; i < bytes; i++)
+	{
+		digit = FGKFASTDecoderDecode(decoder->counts);
+		if (digit < 0 || digit > 0xff)
+		{
+			break;
+		}
+		count |= digit << (8 * i);
+	}
+
+	return count;
+}
+
+int RLEDecoderDecode(RLEDECODER *decoder)
+{
+	int symbol;
+
+	if (decoder->run > 0)
+	{
+		decoder->run--;
+		return decoder->previous;
+	}
+
+	symbol = FGKFASTDecoderDecode(decoder->symbols);
+	if (symbol == FGKFAST_END)
+	{
+		return symbol;
+	}
+	if (RLECoderCount(decoder, symbol))
+	{
+		decoder->run = RLEDecoderRun(decoder);
+		decoder->equal = 0;
+	}
+
+	return symbol;
+}
+
+void RLEDecoderDealloc(RLEDECODER *decoder)
+{
+	RLECoderDealloc(decoder);
+}
+
+long long RLEDecoderBytesRead(RLEDECODER *decoder)
+{
+	return FGKFASTDecoderBytesRead(decoder->symbols);
+}
+
+
+void RLECoderSetWeightLimit(RLECODER *coder, int weightLimit)
+{
+	FGKFASTCoderSetWeightLimit(coder->symbols, weightLimit);
+	FGKFASTCoderSetWeightLimit(coder->counts, weightLimit);
+}
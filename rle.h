@@ -0,0 +1,43 @@
+/*************************************************************************
+ *
+ *	File:	rle.h
+ *	Author:  Jing Huang & Liang Wu
+ *
+ *	Description: run-length pre-stage in front of FGKFAST coding. After
+ *  RLE_THRESHOLD equal symbols the rest of the run is sent as a count
+ *  with its own adaptive model on the same bit stream. A count of
+ *  RLE_LONG_COUNT or more says how many bytes of a longer count follow.
+ *
+ ************************************************************************/
+
+#ifndef __RLE_H_
+#define __RLE_H_
+
+#include "fgkFast.h"
+
+#define RLE_THRESHOLD   3	/* equal symbols coded before a run count is sent */
+#define RLE_LONG_COUNT  253	/* counts 253..255 are followed by a run of 1..3 bytes, low first */
+#define RLE_MAX_RUN     0xffffff	/* longest run a count carries, the rest starts over */
+
+typedef struct 
+{
+	FGKFASTCODER *symbols;	/* owns the bit stream */
+	FGKFASTCODER *counts;	/* run counts and their bytes, 0..255 */
+	int previous;	/* last symbol, -1 before the first */
+	int equal;	/* how many times previous has been coded in a row */
+	int run;	/* encoder: symbols held back; decoder: copies still to output */
+}RLEENCODER, RLEDECODER, RLECODER;
+
+void RLEEncoderFlush(RLEENCODER *encoder);
+void RLEEncoderEncode(RLEENCODER *encoder, int symbol);
+void RLEEncoderEnd(RLEENCODER *encoder);
+RLEENCODER *RLEEncoderAlloc(void *stream, int IsFile);
+void RLEEncoderDealloc(RLEENCODER *encoder);
+long long RLEEncoderBytesWrite(RLEENCODER *encoder);
+int RLEDecoderDecode(RLEDECODER *decoder);
+RLEDECODER *RLEDecoderAlloc(void *stream, int IsFile);
+void RLEDecoderDealloc(RLEDECODER *decoder);
+long long RLEDecoderBytesRead(RLEDECODER *decoder);
+void RLECoderSetWeightLimit(RLECODER *coder, int weightLimit);
+
+#endif
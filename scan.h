@@ -0,0 +1,68 @@
+/*************************************************************************
+ *
+ *	File:	scan.h
+ *	Author:  Jing Huang & Liang Wu
+ *
+ *	Description: find where a run of equal keys starts in the dense key
+ *  array of a fast coder, 8 (AVX2) or 4 (SSE2) keys at a time. Define
+ *  HUFFMAN_NO_SIMD to use the plain loop everywhere.
+ *
+ ************************************************************************/
+
+#ifndef __SCAN_H_
+#define __SCAN_H_
+
+#if !defined(HUFFMAN_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#elif !defined(HUFFMAN_NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* keys[first..last] all equal key, keys[first - 1] does not; returns first,
+ * which is last + 1 when keys[last] is already different */
+static inline int ScanRunStart(const unsigned int *keys, int last, unsigned int key)
+{
+	int i = last;
+
+	/* most runs are empty, which needs no vector at all */
+	if (i < 0 || keys[i] != key)
+	{
+		return i + 1;
+	}
+#if !defined(HUFFMAN_NO_SIMD) && defined(__AVX2__)
+	__m256i wanted = _mm256_set1_epi32((int)key);
+	int mask;
+
+	for ( ; i >= 7; i -= 8)
+	{
+		mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(
+			_mm256_loadu_si256((const __m256i *)(keys + i - 7)), wanted)));
+		if (mask != 0xff)
+		{
+			/* the highest lane that differs ends the run */
+			return i - 7 + (32 - __builtin_clz(~mask & 0xff));
+		}
+	}
+#elif !defined(HUFFMAN_NO_SIMD) && defined(__SSE2__)
+	__m128i wanted = _mm_set1_epi32((int)key);
+	int mask;
+
+	for ( ; i >= 3; i -= 4)
+	{
+		mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(
+			_mm_loadu_si128((const __m128i *)(keys + i - 3)), wanted)));
+		if (mask != 0xf)
+		{
+			/* the highest lane that differs ends the run */
+			return i - 3 + (32 - __builtin_clz(~mask & 0xf));
+		}
+	}
+#endif
+	while (i >= 0 && keys[i] == key)
+	{
+		i--;
+	}
+	return i + 1;
+}
+
+#endif
@@ -0,0 +1,314 @@
+/*************************************************************************
+ *
+ *	File:	state.c
+ *	Author:  Jing Huang & Liang Wu
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "state.h"
+
+
+/* a state is loaded only if it is a tree the fast coders could have built:
+ * parents before children, siblings adjacent, parents holding the sum of
+ * their children, weights never increasing with the number, the zero
+ * node last and one leaf per seen symbol; returns -1 otherwise */
+int StateCheck(const CODERSTATE *state)
+{
+	int children[STATE_MAX_NODES], firstChild[STATE_MAX_NODES];
+	long long sums[STATE_MAX_NODES];
+	unsigned int seen[8];
+	const STATENODE *node;
+	int i, parent;
+
+	if (state->numNodes < 1 || state->numNodes > STATE_MAX_NODES || state->numNodes % 2 == 0)
+	{
+		return -1;
+	}
+
+	for (i = 0; i < state->numNodes; i++)
+	{
+		children[i] = 0;
+		sums[i] = 0;
+	}
+
+	for (i = 0; i < state->numNodes; i++)
+	{
+		node = &state->nodes[i];
+		if (node->weight < 0 || node->symbol < -1 || node->symbol > 255
+			|| (i > 0 && node->weight > state->nodes[i - 1].weight))
+		{
+			return -1;
+		}
+		if (i == 0)
+		{
+			if (node->parent != 0)
+			{
+				return -1;
+			}
+			continue;
+		}
+
+		parent = node->parent - 1;
+		if (parent < 0 || parent >= i || children[parent] == 2
+			|| (children[parent] == 1 && firstChild[parent] != i - 1))
+		{
+			return -1;
+		}
+		if (children[parent] == 0)
+		{
+			firstChild[parent] = i;
+		}
+		children[parent]++;
+		sums[parent] += node->weight;
+	}
+
+	/* every leaf but the zero node holds a symbol of its own, and those
+	 * are the symbols recorded as seen */
+	for (i = 0; i < 8; i++)
+	{
+		seen[i] = 0;
+	}
+	for (i = 0; i < state->numNodes; i++)
+	{
+		node = &state->nodes[i];
+		if (children[i] == 1 || (children[i] == 2 && (sums[i] != node->weight || node->symbol != -1)))
+		{
+			return -1;
+		}
+		if (children[i] == 0 && i < state->numNodes - 1)
+		{
+			if (node->symbol < 0 || (seen[node->symbol / 32] & (1u << (node->symbol % 32))))
+			{
+				return -1;
+			}
+			seen[node->symbol / 32] |= 1u << (node->symbol % 32);
+		}
+	}
+	for (i = 0; i < 8; i++)
+	{
+		if (seen[i] != (unsigned int)state->symbolRecord[i])
+		{
+			return -1;
+		}
+	}
+
+	i = state->numNodes - 1;
+	if (children[i] != 0 || state->nodes[i].weight != 0 || state->nodes[i].symbol != -1)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+
+static int StatePutNumber(unsigned char *buffer, unsigned int value)
+{
+	int n = 0;
+
+	while (value >= 0x80)
+	{
+		buffer[n++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	buffer[n++] = (unsigned char)value;
+
+	return n;
+}
+
+
+static int StateGetNumber(const unsigned char *buffer, int length, int *position, unsigned int *value)
+{
+	int shift;
+
+	*value = 0;
+	for (shift = 0; shift < 35; shift += 7)
+	{
+		if (*position >= length)
+		{
+			return -1;
+		}
+		*value |= (unsigned int)(buffer[*position] & 0x7f) << shift;
+		if ((buffer[(*position)++] & 0x80) == 0)
+		{
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+
+/* pack state into buffer, which holds STATE_MAX_BYTES, and return the bytes
+ * used. Nodes go in number order: one bit each telling internal nodes from
+ * leaves, then the symbol and weight of every leaf but the zero node.
+ * Nodes 2 and 3, 4 and 5, ... are siblings; their parents are usually the
+ * internal nodes in number order, and only when ties of weight have
+ * shuffled them is the pair under each internal node written out.
+ * Internal weights and the seen symbols follow from the leaves. */
+int StateWrite(const CODERSTATE *state, unsigned char *buffer)
+{
+	int pairOf[STATE_MAX_NODES];
+	int i, n, numInternals, inOrder;
+
+	for (i = 0; i < state->numNodes; i++)
+	{
+		pairOf[i] = -1;
+	}
+	for (i = 1; i < state->numNodes; i += 2)
+	{
+		pairOf[state->nodes[i].parent - 1] = (i - 1) / 2;
+	}
+
+	n = 0;
+	buffer[n++] = STATE_VERSION;
+	n += StatePutNumber(buffer + n, state->numNodes);
+
+	memset(buffer + n, 0, (state->numNodes + 7) / 8);
+	numInternals = 0;
+	inOrder = 1;
+	for (i = 0; i < state->numNodes; i++)
+	{
+		if (pairOf[i] != -1)
+		{
+			buffer[n + i / 8] |= 1 << (i % 8);
+			inOrder &= (pairOf[i] == numInternals);
+			numInternals++;
+		}
+	}
+	n += (state->numNodes + 7) / 8;
+
+	buffer[n++] = (unsigned char)inOrder;
+	for (i = 0; !inOrder && i < state->numNodes; i++)
+	{
+		if (pairOf[i] != -1)
+		{
+			buffer[n++] = (unsigned char)pairOf[i];
+		}
+	}
+
+	for (i = 0; i < state->numNodes - 1; i++)
+	{
+		if (pairOf[i] == -1)
+		{
+			buffer[n++] = (unsigned char)state->nodes[i].symbol;
+			n += StatePutNumber(buffer + n, state->nodes[i].weight);
+		}
+	}
+
+	return n;
+}
+
+
+/* unpack what StateWrite() made; returns the bytes used, or -1 if buffer
+ * does not hold a valid state */
+int StateRead(CODERSTATE *state, const unsigned char *buffer, int length)
+{
+	unsigned int value;
+	long long weight;
+	int internal[STATE_MAX_NODES];
+	int i, n, pair, numInternals, numPairs, inOrder;
+
+	n = 0;
+	if (length < 1 || buffer[n++] != STATE_VERSION
+		|| StateGetNumber(buffer, length, &n, &value) == -1
+		|| value < 1 || value > STATE_MAX_NODES || value % 2 == 0)
+	{
+		return -1;
+	}
+	state->numNodes = (int)value;
+	numPairs = (state->numNodes - 1) / 2;
+
+	if (n + (state->numNodes + 7) / 8 + 1 > length)
+	{
+		return -1;
+	}
+	numInternals = 0;
+	for (i = 0; i < state->numNodes; i++)
+	{
+		internal[i] = (buffer[n + i / 8] >> (i % 8)) & 1;
+		numInternals += internal[i];
+		state->nodes[i].symbol = -1;
+		state->nodes[i].weight = 0;
+		state->nodes[i].parent = -1;
+	}
+	n += (state->numNodes + 7) / 8;
+	if (numInternals != numPairs)
+	{
+		return -1;
+	}
+
+	inOrder = buffer[n++];
+	if (!inOrder && n + numInternals > length)
+	{
+		return -1;
+	}
+	pair = 0;
+	for (i = 0; i < state->numNodes; i++)
+	{
+		if (!internal[i])
+		{
+			continue;
+		}
+		if (!inOrder)
+		{
+			pair = buffer[n++];
+		}
+		if (pair >= numPairs || state->nodes[2 * pair + 1].parent != -1)
+		{
+			return -1;
+		}
+		state->nodes[2 * pair + 1].parent = i + 1;
+		state->nodes[2 * pair + 2].parent = i + 1;
+		pair++;
+	}
+	state->nodes[0].parent = 0;
+
+	for (i = 0; i < 8; i++)
+	{
+		state->symbolRecord[i] = 0;
+	}
+	for (i = 0; i < state->numNodes - 1; i++)
+	{
+		if (internal[i])
+		{
+			continue;
+		}
+		if (n >= length)
+		{
+			return -1;
+		}
+		state->nodes[i].symbol = buffer[n++];
+		if (StateGetNumber(buffer, length, &n, &value) == -1 || value > 0x7fffffff)
+		{
+			return -1;
+		}
+		state->nodes[i].weight = (int)value;
+		state->symbolRecord[state->nodes[i].symbol / 32] |= 1u << (state->nodes[i].symbol % 32);
+	}
+
+	/* children are numbered after their parent, so going backwards sums
+	 * every subtree before its parent is reached */
+	for (i = state->numNodes - 1; i > 0; i--)
+	{
+		if (state->nodes[i].parent - 1 >= i)
+		{
+			return -1;
+		}
+		weight = (long long)state->nodes[state->nodes[i].parent - 1].weight + state->nodes[i].weight;
+		if (weight > 0x7fffffff)
+		{
+			return -1;
+		}
+		state->nodes[state->nodes[i].parent - 1].weight = (int)weight;
+	}
+
+	if (StateCheck(state) == -1)
+	{
+		return -1;
+	}
+
+	return n;
+}
@@ -0,0 +1,39 @@
+/*************************************************************************
+ *
+ *	File:	state.h
+ *	Author:  Jing Huang & Liang Wu
+ *
+ *	Description: snapshot of the model of a fast coder: its nodes in number
+ *  order and which symbols it has seen. The bit position is kept apart,
+ *  so a snapshot also serves as a preset model. StateWrite() packs one
+ *  into at most STATE_MAX_BYTES bytes for storing or sending.
+ *
+ ************************************************************************/
+
+#ifndef __STATE_H_
+#define __STATE_H_
+
+#define STATE_MAX_NODES      513
+#define STATE_VERSION        1
+/* version, node count, kind bits, flags, pair order, symbol and weight of every leaf */
+#define STATE_MAX_BYTES      (1 + 2 + 65 + 1 + 256 + 256 * 6)
+
+typedef struct
+{
+	int symbol;	/* -1 for an internal node */
+	int weight;
+	int parent;	/* number of the parent, 0 for the root; of two siblings the lower numbered is the left child */
+}STATENODE;
+
+typedef struct
+{
+	int numNodes;
+	int symbolRecord[8];
+	STATENODE nodes[STATE_MAX_NODES];	/* nodes[i] is node number i + 1 */
+}CODERSTATE;
+
+int StateCheck(const CODERSTATE *state);
+int StateWrite(const CODERSTATE *state, unsigned char *buffer);
+int StateRead(CODERSTATE *state, const unsigned char *buffer, int length);
+
+#endif
@@ -0,0 +1,25 @@
+/*************************************************************************
+ *
+ *	File:	stats.c
+ *	Author:  Jing Huang & Liang Wu
+ *
+ ************************************************************************/
+
+#include "stats.h"
+
+
+/* one JSON object, without a trailing newline so it can be embedded */
+void HuffmanStatsDump(FILE *stream, const HUFFMANSTATS *stats)
+{
+	if (stats == NULL)
+	{
+		fprintf(stream, "null");
+		return;
+	}
+
+	fprintf(stream, "{ \"symbols\": %lld, \"code_bits\": %lld, \"escapes\": %lld, "
+		"\"swaps\": %lld, \"slides\": %lld, \"slide_length\": %lld, "
+		"\"leader_searches\": %lld, \"leader_distance\": %lld, \"max_depth\": %d }",
+		stats->symbols, stats->codeBits, stats->escapes, stats->swaps, stats->slides,
+		stats->slideLength, stats->leaderSearches, stats->leaderDistance, stats->maxDepth);
+}
@@ -0,0 +1,40 @@
+/*************************************************************************
+ *
+ *	File:	stats.h
+ *	Author:  Jing Huang & Liang Wu
+ *
+ *	Description: per stream counters of the tree dynamics, only counted
+ *  when built with HUFFMAN_STATS.
+ *
+ ************************************************************************/
+
+#ifndef __STATS_H_
+#define __STATS_H_
+
+#include <stdio.h>
+
+typedef struct
+{
+	long long symbols;	/* symbols coded */
+	long long codeBits;	/* bits written or read, raw symbol bits included */
+	long long escapes;	/* symbols sent through the zero node */
+	long long swaps;	/* node exchanges while updating */
+	long long slides;	/* slideNodes() calls */
+	long long slideLength;	/* nodes slid over */
+	long long leaderSearches;	/* scans for the leader of a block */
+	long long leaderDistance;	/* numbers between a node and its leader */
+	int maxDepth;	/* deepest node coded */
+}HUFFMANSTATS;
+
+#ifdef HUFFMAN_STATS
+#define STATS_ADD(coder, field, n) ((coder)->stats.field += (n))
+#define STATS_MAX(coder, field, n) \
+	do { if ((n) > (coder)->stats.field) (coder)->stats.field = (n); } while (0)
+#else
+#define STATS_ADD(coder, field, n)
+#define STATS_MAX(coder, field, n)
+#endif
+
+void HuffmanStatsDump(FILE *stream, const HUFFMANSTATS *stats);
+
+#endif
@@ -6,34 +6,82 @@
  *
  ************************************************************************/
 
+#include <string.h>
+#include <pthread.h>
 #include "timer.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
-static clock_t start;
-static clock_t finish;
+
+typedef struct
+{
+	unsigned long long ticks;
+	unsigned long long start;
+	long long calls;
+}TIMERSLOT;
+
+static _Thread_local double start;
+static _Thread_local double finish;
+
+static const char *timerNames[TIMER_MAX_NAMED];
+static int numTimers = 0;
+static TIMERSLOT timerTotals[TIMER_MAX_NAMED];
+static _Thread_local TIMERSLOT timerSlots[TIMER_MAX_NAMED];
+static pthread_mutex_t timerLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* ticks and seconds at the first registration, to convert ticks to seconds */
+static unsigned long long baseTicks;
+static double baseSeconds;
+
+
+double TimerNow(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+
+/* the time stamp counter where there is one, nanoseconds otherwise */
+unsigned long long TimerTicks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+}
 
 
 void StartTimer(void)
 {
-	start = clock(); 
+	start = TimerNow(); 
 }
 
 
 void StopTimer(void)
 {
-	finish = clock(); 
+	finish = TimerNow(); 
 }
 
 
 double CurrentTime(void)
 {
-	return ((double)(clock() - start) / CLOCKS_PER_SEC);
+	return TimerNow() - start;
 }
 
 
 double ElapsedTime(void)
 {
-	return ((double)(finish - start) / CLOCKS_PER_SEC);
+	return finish - start;
 }
 
 
@@ -43,4 +91,94 @@ char *today(void)
 	struct tm * curtime = localtime(&now);
 	
 	return (asctime(curtime));		
-}
\ No newline at end of file
+}
+
+
+/* id of the named timer, registered on first use; -1 if the table is full */
+int TimerId(const char *name)
+{
+	int i;
+
+	pthread_mutex_lock(&timerLock);
+	for (i = 0; i < numTimers; i++)
+	{
+		if (strcmp(timerNames[i], name) == 0)
+		{
+			break;
+		}
+	}
+	if (i == numTimers)
+	{
+		if (numTimers == TIMER_MAX_NAMED)
+		{
+			i = -1;
+		}
+		else
+		{
+			if (numTimers == 0)
+			{
+				baseSeconds = TimerNow();
+				baseTicks = TimerTicks();
+			}
+			timerNames[numTimers++] = name;
+		}
+	}
+	pthread_mutex_unlock(&timerLock);
+
+	return i;
+}
+
+
+void TimerBegin(int id)
+{
+	if (id < 0) return;
+	timerSlots[id].start = TimerTicks();
+}
+
+
+void TimerEnd(int id)
+{
+	if (id < 0) return;
+	timerSlots[id].ticks += TimerTicks() - timerSlots[id].start;
+	timerSlots[id].calls++;
+}
+
+
+void TimerMerge(void)
+{
+	int i;
+
+	pthread_mutex_lock(&timerLock);
+	for (i = 0; i < numTimers; i++)
+	{
+		timerTotals[i].ticks += timerSlots[i].ticks;
+		timerTotals[i].calls += timerSlots[i].calls;
+		timerSlots[i].ticks = 0;
+		timerSlots[i].calls = 0;
+	}
+	pthread_mutex_unlock(&timerLock);
+}
+
+
+/* merge the calling thread and print every named timer */
+void TimerReport(FILE *stream)
+{
+	double ticksPerSecond;
+	int i;
+
+	TimerMerge();
+
+	pthread_mutex_lock(&timerLock);
+	if (numTimers > 0)
+	{
+		ticksPerSecond = (TimerTicks() - baseTicks) / (TimerNow() - baseSeconds);
+		fprintf(stream, "%-24s %12s %12s %14s\n", "timer", "calls", "seconds", "ticks/call");
+		for (i = 0; i < numTimers; i++)
+		{
+			fprintf(stream, "%-24s %12lld %12.6f %14.1f\n", timerNames[i], timerTotals[i].calls,
+				timerTotals[i].ticks / ticksPerSecond,
+				timerTotals[i].calls ? (double)timerTotals[i].ticks / timerTotals[i].calls : 0.0);
+		}
+	}
+	pthread_mutex_unlock(&timerLock);
+}
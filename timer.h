@@ -13,12 +13,36 @@
 #include <stdlib.h>
 #include <time.h>
 
+#define TIMER_MAX_NAMED  32	/* named timers a program can register */
 
+
+/* one wall-clock stopwatch per thread */
 void StartTimer(void);
 void StopTimer(void);
 double CurrentTime(void);
 double ElapsedTime(void);
 char *today(void); 
 
+/* named timers: ticks are summed per thread and folded into the totals by
+ * TimerMerge(), which a worker thread calls before it exits */
+double TimerNow(void);
+unsigned long long TimerTicks(void);
+int TimerId(const char *name);
+void TimerBegin(int id);
+void TimerEnd(int id);
+void TimerMerge(void);
+void TimerReport(FILE *stream);
+
+/* per-symbol timers inside the engines, only built in with HUFFMAN_PROFILE */
+#ifdef HUFFMAN_PROFILE
+#define PROFILE_BEGIN(name) do { static int profileId = -1; \
+	if (profileId < 0) { profileId = TimerId(name); } TimerBegin(profileId); } while (0)
+#define PROFILE_END(name) do { static int profileId = -1; \
+	if (profileId < 0) { profileId = TimerId(name); } TimerEnd(profileId); } while (0)
+#else
+#define PROFILE_BEGIN(name)
+#define PROFILE_END(name)
+#endif
+
 
 #endif 
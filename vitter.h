@@ -12,8 +12,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include "weight.h"
 
 #define NUM_BITS_IN_INT      32
+#define VITTER_END           256	/* decoded the end of the stream */
 
 typedef struct VITTERNode
 {
@@ -33,11 +35,11 @@ typedef struct
 typedef struct 
 {
 	int IsFile;	
-    int rack, value, CurrentBytes;
+    int rack, value;
+	long long CurrentBytes;
 	int InBits, OutBits;
 	int symbolRecord[8];
-	int bit;
-	bool hasBit;
+	int weightLimit;	/* root weight at which all weights are halved */
 	unsigned char mask;
 	void *stream;
 	VITTERTREE *tree;
@@ -49,11 +51,13 @@ typedef struct
 void VITTEREncoderFlush(VITTERENCODER *encoder);
 VITTERENCODER *VITTEREncoderAlloc(void *stream, int IsFile);
 void VITTEREncoderEncode(VITTERENCODER *encoder, int symbol);
+void VITTEREncoderEnd(VITTERENCODER *encoder);
 void VITTEREncoderDealloc(VITTERENCODER *encoder);
-int VITTEREncoderBytesWrite(VITTERDECODER *encoder);
-VITTERDECODER *VITTERDEcoderAlloc(void *stream, int IsFile);
+long long VITTEREncoderBytesWrite(VITTERDECODER *encoder);
+VITTERDECODER *VITTERDecoderAlloc(void *stream, int IsFile);
 int VITTERDecoderDecode(VITTERDECODER *decoder);
 void VITTERDecoderDealloc(VITTERDECODER *decoder);
-int VITTERDecoderBytesRead(VITTERDECODER *decoder);
+long long VITTERDecoderBytesRead(VITTERDECODER *decoder);
+void VITTERCoderSetWeightLimit(VITTERCODER *coder, int weightLimit);
 
 #endif
\ No newline at end of file
@@ -10,13 +10,22 @@
  *
  ************************************************************************/
 
-#include "VITTERFAST.h"
+#include <string.h>
+#include "vitterFast.h"
+#include "timer.h"
+#include "prefetch.h"
+#include "scan.h"
+#include "iochain.h"
 
-static int GetByte(void *stream, int *CurrentBytes, int IsFile)
+static int GetByte(void *stream, long long *CurrentBytes, int IsFile)
 {
 	int value;
 	
-	if (IsFile)
+	if (IsFile == IOCHAIN_STREAM)
+	{
+		value = IOChainGet((IOCHAIN *)stream);
+	}
+	else if (IsFile)
 	{
 		value = getc((FILE *)stream);
 	}
@@ -31,9 +40,13 @@ static int GetByte(void *stream, int *CurrentBytes, int IsFile)
 }
 
 
-static void PutByte(void *stream, int value, int *CurrentBytes, int IsFile)
+static void PutByte(void *stream, int value, long long *CurrentBytes, int IsFile)
 {
-	if (IsFile)
+	if (IsFile == IOCHAIN_STREAM)
+	{
+		IOChainPut((IOCHAIN *)stream, value);
+	}
+	else if (IsFile)
 	{
 		putc(value, (FILE *)stream);
 	}
@@ -49,6 +62,7 @@ static int GetBit(VITTERFASTDECODER *decoder)
 {
 	int value;
 	
+	STATS_ADD(decoder, codeBits, 1);
 	if (decoder->mask == 0x80)
 	{
         decoder->rack = GetByte(decoder->stream, &(decoder->CurrentBytes), decoder->IsFile);
@@ -68,6 +82,7 @@ static int GetBit(VITTERFASTDECODER *decoder)
 
 static void PutBit(VITTERFASTENCODER *encoder, int bit)
 {
+	STATS_ADD(encoder, codeBits, 1);
 	if (bit)
 	{
 		encoder->rack |= encoder->mask;
@@ -96,13 +111,13 @@ static void PrintVITTERFASTTree(VITTERFASTTREENODE *localRoot)
 {
 	printf("number = %d, weight = %d, symbol = %d\n", localRoot->number, localRoot->weight, localRoot->symbol);
 	
-	if (localRoot->left != NULL)
+	if (localRoot->child[0] != NULL)
 	{
-		PrintVITTERFASTTree(localRoot->left);
+		PrintVITTERFASTTree(localRoot->child[0]);
 	}
-	if (localRoot->right != NULL)
+	if (localRoot->child[1] != NULL)
 	{
-		PrintVITTERFASTTree(localRoot->right);
+		PrintVITTERFASTTree(localRoot->child[1]);
 	}
 	
 }
@@ -119,12 +134,13 @@ static VITTERFASTTREENODE *VITTERFASTTreeNodeInit(VITTERFASTCODER *coder)
 	node->symbol = -1;
 	node->weight = 0;
 	node->number = coder->tree->maxNumber + 1;
-	node->isLeft = false;
+	node->side = 1;
 	node->parent = NULL;
-	node->left = NULL;
-	node->right = NULL;
+	node->child[0] = NULL;
+	node->child[1] = NULL;
 	
 	coder->nodeList[coder->tree->maxNumber] = node;
+	coder->keys[coder->tree->maxNumber] = 1;
 	coder->tree->zeroNode = node;
 	coder->tree->maxNumber++;
 	
@@ -148,10 +164,13 @@ static int VITTERFASTEncoderInit(VITTERFASTENCODER *encoder, void *stream, int I
 	int i;
 	encoder->IsFile = IsFile;	
 	encoder->OutBits = 0;
+	encoder->weightLimit = MAX_WEIGHT;
+	memset(&encoder->stats, 0, sizeof(HUFFMANSTATS));
 	encoder->CurrentBytes = 0;
 	encoder->rack = 0;
 	encoder->mask = 0x80;
 	encoder->stream = stream;
+	encoder->hotLimit = 0;
 	
 	for (i = 0; i < 8; i++)
 	{
@@ -208,8 +227,8 @@ static VITTERFASTTREENODE *findZeroNode(VITTERFASTTREENODE *localRoot)
 	}
 	else if (localRoot != NULL && localRoot->weight != 0)
 	{
-		node1 = findZeroNode(localRoot->left);
-		node2 = findZeroNode(localRoot->right);
+		node1 = findZeroNode(localRoot->child[0]);
+		node2 = findZeroNode(localRoot->child[1]);
 		if (node1 != NULL)
 		{
 			return node1;
@@ -240,14 +259,7 @@ static void OutputNodeCode(VITTERFASTENCODER *encoder, VITTERFASTTREENODE *node)
        and record each bit along the way in reversedOutputBits arrays */
 	while (iter != encoder->tree->root)
 	{
-		if (iter->isLeft)
-		{
-			reversedOutputBits[depth++] = 0;	
-		}
-		else
-		{
-			reversedOutputBits[depth++] = 1;
-		}
+		reversedOutputBits[depth++] = iter->side;
 		iter = iter->parent;
 	}
 	
@@ -259,6 +271,7 @@ static void OutputNodeCode(VITTERFASTENCODER *encoder, VITTERFASTTREENODE *node)
 		bit = reversedOutputBits[i];
 		PutBit(encoder, bit);
 	}
+	STATS_MAX(encoder, maxDepth, depth);
 }
 
 static void OutputZeroNodeCode(VITTERFASTENCODER *encoder, VITTERFASTTREENODE *zeroNode, int symbol)
@@ -266,6 +279,7 @@ static void OutputZeroNodeCode(VITTERFASTENCODER *encoder, VITTERFASTTREENODE *z
 	int i, bit;
 	
 	OutputNodeCode(encoder, zeroNode);
+	STATS_ADD(encoder, escapes, 1);
 	
 	/* specify which symbol it is */	
 	for (i = 7; i >= 0; i--)
@@ -351,14 +365,7 @@ static bool isZeroNodeSibling(VITTERFASTTREENODE *node)
 	VITTERFASTTREENODE *sibling;
 	if (node->parent != NULL)
 	{
-		if (node->isLeft == true)
-		{
-			sibling = node->parent->right;
-		}
-		else
-		{
-			sibling = node->parent->left;
-		}
+		sibling = node->parent->child[node->side ^ 1];
 		if (sibling->weight == 0)
 		{
 			return true;
@@ -369,23 +376,27 @@ static bool isZeroNodeSibling(VITTERFASTTREENODE *node)
 
 static bool isLeafNode(VITTERFASTTREENODE *node)
 {
-	if (node->left == NULL)
+	if (node->child[0] == NULL)
 	{
 		return true;
 	}
 	return false;
 }
 
+/* a leaf sorts after the internal nodes of its weight, so one compare of
+ * keys tells both weight and kind */
+static unsigned int nodeKey(VITTERFASTTREENODE *node)
+{
+	return 2u * node->weight + isLeafNode(node);
+}
+
 
+/* node leads its leaf block, so the nodes of its weight below it are all
+ * internal */
 static void findSameWeightInternalNodes(VITTERFASTCODER *coder, VITTERFASTTREENODE *sameWeightNodes[256], VITTERFASTTREENODE *node, int *count)
 {
-	int i =  node->number - 2;
 	int j;
-	while (coder->nodeList[i]->weight == node->weight)
-	{		
-		i--;
-	}
-	for (j = i + 1; j < node->number - 1; j++)
+	for (j = ScanRunStart(coder->keys, node->number - 2, 2u * node->weight); j < node->number - 1; j++)
 	{
 		sameWeightNodes[*count] = coder->nodeList[j];
 		*count += 1;
@@ -395,13 +406,8 @@ static void findSameWeightInternalNodes(VITTERFASTCODER *coder, VITTERFASTTREENO
 	
 static void findSameWeightLeafNodes(VITTERFASTCODER *coder, VITTERFASTTREENODE *sameWeightNodes[256], VITTERFASTTREENODE *node, int *count)
 {
-	int i =  node->number - 2;
 	int j;
-	while (coder->nodeList[i]->weight == node->weight + 1 && isLeafNode(coder->nodeList[i]))
-	{		
-		i--;
-	}
-	for (j = i + 1; j < node->number - 1; j++)
+	for (j = ScanRunStart(coder->keys, node->number - 2, 2u * (node->weight + 1) + 1); j < node->number - 1; j++)
 	{
 		sameWeightNodes[*count] = coder->nodeList[j];
 		*count += 1;
@@ -413,13 +419,15 @@ VITTERFASTTREENODE *findLeaderInLeafBlock(VITTERFASTCODER *coder, VITTERFASTTREE
 	VITTERFASTTREENODE *iter = node;
 	int i;
 	
-	i = node->number - 2;
-	while (coder->nodeList[i]->weight == node->weight && isLeafNode(coder->nodeList[i]))
+	i = ScanRunStart(coder->keys, node->number - 2, 2u * node->weight + 1);
+	if (i < node->number - 1)
 	{
 		iter = coder->nodeList[i];
-		i--;
 	}
 	
+	STATS_ADD(coder, leaderSearches, 1);
+	STATS_ADD(coder, leaderDistance, node->number - iter->number);
+	
 	return iter;
 }
 
@@ -463,11 +471,63 @@ void sortByIncrementNumber(VITTERFASTTREENODE *sameWeightNodes[256], int count)
 	quickSort(sameWeightNodes, 0, count -1);
 }
 
+#ifdef HUFFMAN_HOT_TOP
+/* nodes move among the numbers from number on; hotTop only holds numbers up
+ * to hotLimit, so it is still right unless number is within them */
+static void hotTopTouch(VITTERFASTCODER *coder, int number)
+{
+	if (number <= coder->hotLimit)
+	{
+		coder->hotLimit = 0;
+	}
+}
+
+/* keep the top VITTERFAST_HOT_LEVELS levels of the tree in hotTop, the
+ * children of position i at 2i+1 and 2i+2, and their shape in hotLeaves, so
+ * the first steps of a decode walk need no load at all */
+static void hotTopBuild(VITTERFASTCODER *coder)
+{
+	VITTERFASTTREENODE *node;
+	int i;
+
+	coder->hotTop[0] = coder->tree->root;
+	coder->hotLeaves = 0;
+	coder->hotLimit = 0;
+	for (i = 0; i < VITTERFAST_HOT_SIZE; i++)
+	{
+		node = coder->hotTop[i];
+		if (i < (1 << VITTERFAST_HOT_LEVELS) - 1)
+		{
+			coder->hotTop[2 * i + 1] = (node == NULL || isLeafNode(node)) ? NULL : node->child[0];
+			coder->hotTop[2 * i + 2] = (node == NULL || isLeafNode(node)) ? NULL : node->child[1];
+		}
+		if (node == NULL)
+		{
+			continue;
+		}
+		if (isLeafNode(node))
+		{
+			coder->hotLeaves |= 1u << i;
+		}
+		if (node->number > coder->hotLimit)
+		{
+			coder->hotLimit = node->number;
+		}
+	}
+}
+#else
+#define hotTopTouch(coder, number)
+#endif
+
 void slideNodes(VITTERFASTTREENODE *sameWeightNodes[256], VITTERFASTTREENODE *node, VITTERFASTCODER *coder, int count)
 {
 	VITTERFASTTREENODE *iter, *tempNode, *tempNode2;
-	int i, tempNumber;
-	bool tempIsLeft;
+	int i, tempNumber, tempSide;
+	
+	STATS_ADD(coder, slides, 1);
+	STATS_ADD(coder, slideLength, count);
+	/* the nodes slid over are numbered from sameWeightNodes[0] up to node */
+	hotTopTouch(coder, sameWeightNodes[0]->number);
 	
 	tempNode2 = coder->nodeList[node->number - 1];
 	coder->nodeList[node->number - 1] = coder->nodeList[sameWeightNodes[count - 1]->number - 1];
@@ -479,59 +539,66 @@ void slideNodes(VITTERFASTTREENODE *sameWeightNodes[256], VITTERFASTTREENODE *no
 	
 	
 	tempNode = sameWeightNodes[0]->parent;
-	tempIsLeft = sameWeightNodes[0]->isLeft;
+	tempSide = sameWeightNodes[0]->side;
 	tempNumber = sameWeightNodes[0]->number;	
 	
 	for (i = 0; i < count - 1; i++)
 	{
 		iter = sameWeightNodes[i];			
 		iter->parent = sameWeightNodes[i + 1]->parent;
-		iter->isLeft = sameWeightNodes[i + 1]->isLeft;
+		iter->side = sameWeightNodes[i + 1]->side;
 		iter->number = sameWeightNodes[i + 1]->number;
 		if (sameWeightNodes[i + 1]->parent != NULL)
 		{
-			if (sameWeightNodes[i + 1]->isLeft)
-				sameWeightNodes[i + 1]->parent->left = iter;
-			else
-				sameWeightNodes[i + 1]->parent->right = iter;
+			sameWeightNodes[i + 1]->parent->child[sameWeightNodes[i + 1]->side] = iter;
 		}
 	}
 	iter = sameWeightNodes[count - 1];
 	iter->parent = node->parent;
-	iter->isLeft = node->isLeft;
+	iter->side = node->side;
 	iter->number = node->number;
 	if (node->parent != NULL)
 	{
-		if (node->isLeft)
-			node->parent->left = iter;
-		else
-			node->parent->right = iter;
+		node->parent->child[node->side] = iter;
 	}
 	
 	iter = node;
 	iter->parent = tempNode;
-	iter->isLeft = tempIsLeft;
+	iter->side = tempSide;
 	iter->number = tempNumber;
 	if (tempNode != NULL)
 	{
-		if (tempIsLeft)
-			tempNode->left = iter;
-		else
-			tempNode->right = iter;
+		tempNode->child[tempSide] = iter;
+	}
+	
+	coder->keys[node->number - 1] = nodeKey(node);
+	for (i = 0; i < count; i++)
+	{
+		coder->keys[sameWeightNodes[i]->number - 1] = nodeKey(sameWeightNodes[i]);
 	}
 	
 	
 }
 
 
+/* start loading what the next step up from node reads: its parent and the
+ * node numbered just below, where the search for its block begins */
+static void prefetchStep(VITTERFASTCODER *coder, VITTERFASTTREENODE *node)
+{
+	HUFFMAN_PREFETCH(node->parent);
+	if (node->number > 1)
+	{
+		HUFFMAN_PREFETCH(coder->nodeList[node->number - 2]);
+	}
+}
+
 VITTERFASTTREENODE *slideAndIncrement(VITTERFASTCODER *coder, VITTERFASTTREENODE *node)
 {
 	VITTERFASTTREENODE *iter = NULL;
 	VITTERFASTTREENODE *sameWeightNodes[256];
 	VITTERFASTTREENODE *tempNode;
 	int weight = node->weight;
-	int i, count, number;
-	bool tempIsLeft;
+	int i, count, number, tempSide;
 	iter = node;	
 	count = 0;
 	
@@ -539,17 +606,29 @@ VITTERFASTTREENODE *slideAndIncrement(VITTERFASTCODER *coder, VITTERFASTTREENODE
 	{
 		findSameWeightInternalNodes(coder, sameWeightNodes, node, &count);
 		//printSameWeightNodes(sameWeightNodes, count);
+		
+		/* the leaf ends up under the parent of the first node it passes */
+		tempNode = count > 0 ? sameWeightNodes[0]->parent : iter->parent;
+		if (tempNode != NULL)
+		{
+			prefetchStep(coder, tempNode);
+		}
 		if (count > 0)
 		{
 			//sortByIncrementNumber(sameWeightNodes, count);
 			slideNodes(sameWeightNodes, iter, coder, count);
 		}
 		iter->weight++;
+		coder->keys[iter->number - 1] += 2;
 		iter = iter->parent;		
 	}
 	else
 	{
 		tempNode = iter->parent;
+		if (tempNode != NULL)
+		{
+			prefetchStep(coder, tempNode);
+		}
 		findSameWeightLeafNodes(coder, sameWeightNodes, node, &count);
 		//printSameWeightNodes(sameWeightNodes, count);
 		if (count > 0)
@@ -558,18 +637,182 @@ VITTERFASTTREENODE *slideAndIncrement(VITTERFASTCODER *coder, VITTERFASTTREENODE
 			slideNodes(sameWeightNodes, iter, coder, count);
 		}
 		iter->weight++;
+		coder->keys[iter->number - 1] += 2;
 		iter = tempNode;		
 	}
 	return iter;
 }
 		
 
+/* rebuild the tree in place from the same nodes, first halving the weight of
+ * every seen symbol (a seen symbol keeps at least 1) if asked: leaves are
+ * merged in order of increasing weight, leaves before internal nodes of
+ * equal weight, and numbered back from the root so the sibling property holds
+ * again. The zero node stays the highest numbered leaf. Encoder and decoder
+ * do this at the same symbol. */
+static void VITTERFASTTreeRebuild(VITTERFASTCODER *coder, bool halve)
+{
+	VITTERFASTTREENODE *leaves[257], *internals[256], *merged[256], *order[513];
+	VITTERFASTTREENODE *pair[2], *parent;
+	int numLeaves, numInternals, numMerged, i, j, k, m, count;
+
+	if (coder->tree->maxNumber < 3)
+	{
+		return;
+	}
+
+	/* nodeList is in decreasing weight order, so walking it backwards yields
+	 * the leaves in increasing weight, which halving does not change; a leaf
+	 * raised by a bulk update is moved back into place */
+	numLeaves = 0;
+	numInternals = 0;
+	for (i = coder->tree->maxNumber - 1; i >= 0; i--)
+	{
+		if (isLeafNode(coder->nodeList[i]))
+		{
+			parent = coder->nodeList[i];
+			if (halve)
+			{
+				parent->weight = (parent->weight + 1) / 2;
+			}
+			for (j = numLeaves; j > 0 && leaves[j - 1]->weight > parent->weight; j--)
+			{
+				leaves[j] = leaves[j - 1];
+			}
+			leaves[j] = parent;
+			numLeaves++;
+		}
+		else
+		{
+			internals[numInternals++] = coder->nodeList[i];
+		}
+	}
+
+	/* two-queue Huffman merge reusing the internal nodes; taking leaves first
+	 * on ties keeps internal nodes ahead of the leaves of their weight */
+	i = 0;
+	j = 0;
+	numMerged = 0;
+	count = 0;
+	for (m = 0; m < numInternals; m++)
+	{
+		for (k = 0; k < 2; k++)
+		{
+			if (j >= numMerged || (i < numLeaves && leaves[i]->weight <= merged[j]->weight))
+			{
+				pair[k] = leaves[i++];
+			}
+			else
+			{
+				pair[k] = merged[j++];
+			}
+			order[count++] = pair[k];
+		}
+
+		parent = internals[m];
+		parent->weight = pair[0]->weight + pair[1]->weight;
+		parent->child[1] = pair[0];
+		parent->child[0] = pair[1];
+		pair[0]->parent = parent;
+		pair[0]->side = 1;
+		pair[1]->parent = parent;
+		pair[1]->side = 0;
+		merged[numMerged++] = parent;
+	}
+
+	parent = merged[numMerged - 1];
+	parent->parent = NULL;
+	parent->side = 1;
+	order[count++] = parent;
+	coder->tree->root = parent;
+	coder->hotLimit = 0;
+
+	/* the last node merged is the root, number 1 */
+	for (i = 0; i < count; i++)
+	{
+		order[i]->number = count - i;
+		coder->nodeList[count - i - 1] = order[i];
+		coder->keys[count - i - 1] = nodeKey(order[i]);
+	}
+}
+
+static void VITTERFASTTreeRescale(VITTERFASTCODER *coder)
+{
+	VITTERFASTTreeRebuild(coder, true);
+}
+
+#ifdef HUFFMAN_DEBUG
+/* stop at the first broken invariant: numbering matches nodeList, weights
+ * never increase with the number, siblings are adjacent, parents hold the
+ * sum of their children and the zero node is the last node */
+static void VITTERFASTTreeCheck(VITTERFASTCODER *coder)
+{
+	VITTERFASTTREENODE *node;
+	int i;
+
+	if (coder->tree->root != coder->nodeList[0] || coder->tree->root->parent != NULL)
+	{
+		printf("VITTERFASTTreeCheck(): root is not node 1\n");
+		abort();
+	}
+	if (coder->tree->zeroNode->weight != 0 || coder->tree->zeroNode->number != coder->tree->maxNumber)
+	{
+		printf("VITTERFASTTreeCheck(): zero node is not the last node\n");
+		abort();
+	}
+
+	for (i = 0; i < coder->tree->maxNumber; i++)
+	{
+		node = coder->nodeList[i];
+		if (node->number != i + 1)
+		{
+			printf("VITTERFASTTreeCheck(): node %d is numbered %d\n", i + 1, node->number);
+			abort();
+		}
+		if (i > 0 && coder->nodeList[i - 1]->weight < node->weight)
+		{
+			printf("VITTERFASTTreeCheck(): node %d outweighs node %d\n", i + 1, i);
+			abort();
+		}
+		if (i > 0 && coder->nodeList[i - 1]->weight == node->weight
+			&& isLeafNode(coder->nodeList[i - 1]) && !isLeafNode(node))
+		{
+			printf("VITTERFASTTreeCheck(): leaf %d ahead of internal node %d\n", i, i + 1);
+			abort();
+		}
+		if (coder->keys[i] != nodeKey(node))
+		{
+			printf("VITTERFASTTreeCheck(): key of node %d is stale\n", i + 1);
+			abort();
+		}
+		if (isLeafNode(node))
+		{
+			continue;
+		}
+		if (node->child[0]->number + 1 != node->child[1]->number
+			|| node->child[0]->weight + node->child[1]->weight != node->weight)
+		{
+			printf("VITTERFASTTreeCheck(): children of node %d break the sibling property\n", i + 1);
+			abort();
+		}
+		if (node->child[0]->parent != node || node->child[1]->parent != node
+			|| node->child[0]->side != 0 || node->child[1]->side != 1)
+		{
+			printf("VITTERFASTTreeCheck(): children of node %d are linked wrong\n", i + 1);
+			abort();
+		}
+	}
+}
+#define VITTERFAST_CHECK(coder) VITTERFASTTreeCheck(coder)
+#else
+#define VITTERFAST_CHECK(coder)
+#endif
+
 static void VITTERFASTTreeUpdate(VITTERFASTCODER *coder, VITTERFASTTREENODE *node, int symbol)
 {
 	VITTERFASTTREENODE *parentOfZeroNode, *newZeroNode, *iter, *tempNode, *leader, *parentOfIter;
 	VITTERFASTTREENODE *leafToIncrement = NULL;	
-	int tempNumber, i, j;	
-	bool tempIsLeft;	
+	int tempNumber, tempSide, i, j;	
 	iter = node;
 	
 	/* if iter is zero node */
@@ -578,7 +821,8 @@ static void VITTERFASTTreeUpdate(VITTERFASTCODER *coder, VITTERFASTTREENODE *nod
 		/* update the record of which symbol has existed */
 		i = symbol / NUM_BITS_IN_INT;
 		j = symbol % NUM_BITS_IN_INT;		
-		coder->symbolRecord[i] |=  (1 << j);		
+		coder->symbolRecord[i] |=  (1U << j);		
+		hotTopTouch(coder, iter->number);
 				
 		/* replace iter by a parent 0-node with two leaf 0-node children, 
 		 * and numbered in the order parent, left child, and right child (different from algorithm description),
@@ -590,11 +834,10 @@ static void VITTERFASTTreeUpdate(VITTERFASTCODER *coder, VITTERFASTTREENODE *nod
 		
 		if (iter->parent != NULL)
 		{
-			if (iter->isLeft) iter->parent->left = parentOfZeroNode;
-			else iter->parent->right = parentOfZeroNode;
+			iter->parent->child[iter->side] = parentOfZeroNode;
 		}		
-		parentOfZeroNode->left = iter;
-		parentOfZeroNode->right = newZeroNode;
+		parentOfZeroNode->child[0] = iter;
+		parentOfZeroNode->child[1] = newZeroNode;
 		iter->parent = parentOfZeroNode;
 		newZeroNode->parent = parentOfZeroNode;
 		
@@ -605,8 +848,10 @@ static void VITTERFASTTreeUpdate(VITTERFASTCODER *coder, VITTERFASTTREENODE *nod
 		tempNumber = parentOfZeroNode->number;
 		parentOfZeroNode->number = iter->number;
 		iter->number = tempNumber; 
-		iter->isLeft = true;
+		iter->side = 0;
 		iter->symbol = symbol;
+		coder->keys[parentOfZeroNode->number - 1] = nodeKey(parentOfZeroNode);
+		coder->keys[iter->number - 1] = nodeKey(iter);
 		leafToIncrement = iter;
 		iter = parentOfZeroNode;
 		
@@ -624,26 +869,14 @@ static void VITTERFASTTreeUpdate(VITTERFASTCODER *coder, VITTERFASTTREENODE *nod
 
 		if (iter != leader)
 		{
+			STATS_ADD(coder, swaps, 1);
+			hotTopTouch(coder, leader->number);
 			/* replace this leaf with iter */
-			if (leader->isLeft)
-			{
-				leader->parent->left = iter;
-			}
-			else
-			{
-				leader->parent->right = iter;
-			}
-			if (iter->isLeft)
-			{
-				iter->parent->left = leader;
-			}
-			else
-			{
-				iter->parent->right = leader;
-			}
-			tempIsLeft = iter->isLeft;
-			iter->isLeft = leader->isLeft;
-			leader->isLeft = tempIsLeft;
+			leader->parent->child[leader->side] = iter;
+			iter->parent->child[iter->side] = leader;
+			tempSide = iter->side;
+			iter->side = leader->side;
+			leader->side = tempSide;
 			
 			tempNode = iter->parent;
 			iter->parent = leader->parent;
@@ -680,11 +913,19 @@ static void VITTERFASTTreeUpdate(VITTERFASTCODER *coder, VITTERFASTTREENODE *nod
 	if (iter == coder->tree->root)
 	{
 		iter->weight++;
+		coder->keys[0] += 2;
 	}
 	if (leafToIncrement != NULL)
 	{
 		parentOfIter = slideAndIncrement(coder, leafToIncrement);
 	}
+	
+	if (coder->tree->root->weight >= coder->weightLimit)
+	{
+		VITTERFASTTreeRescale(coder);
+	}
+	
+	VITTERFAST_CHECK(coder);
 }
 
 
@@ -693,17 +934,39 @@ void VITTERFASTEncoderEncode(VITTERFASTENCODER *encoder, int symbol)
 { 
 	//printf("\n");
 	//printf("symbol = %d\n", symbol);
-	VITTERFASTTREENODE *node = VITTERFASTEncoderOutputCode(encoder, symbol);
-	VITTERFASTTreeUpdate(encoder, node, symbol);	
+	VITTERFASTTREENODE *node;
+	
+	PROFILE_BEGIN("vitterfast.enc.output");
+	node = VITTERFASTEncoderOutputCode(encoder, symbol);
+	STATS_ADD(encoder, symbols, 1);
+	PROFILE_END("vitterfast.enc.output");
+	PROFILE_BEGIN("vitterfast.enc.update");
+	VITTERFASTTreeUpdate(encoder, node, symbol);
+	PROFILE_END("vitterfast.enc.update");	
 	//PrintVITTERFASTTree(encoder->tree->root);
 }
 
+/* end of the stream: the zero node code followed by a symbol already seen,
+ * which no real escape can carry. A stream without symbols needs none */
+void VITTERFASTEncoderEnd(VITTERFASTENCODER *encoder)
+{
+	int symbol;
+
+	for (symbol = 0; symbol < 256 && !isExisted(encoder, symbol); symbol++)
+	{
+	}
+	if (symbol < 256)
+	{
+		OutputZeroNodeCode(encoder, encoder->tree->zeroNode, symbol);
+	}
+}
+
 /* post-order traverse and delete tree nodes */
 static void VITTERFASTTreeNodesDealloc(VITTERFASTTREENODE *localRoot)  
 {
 	if (localRoot == NULL) return;
-	VITTERFASTTreeNodesDealloc(localRoot->left);
-	VITTERFASTTreeNodesDealloc(localRoot->right);
+	VITTERFASTTreeNodesDealloc(localRoot->child[0]);
+	VITTERFASTTreeNodesDealloc(localRoot->child[1]);
 	free(localRoot);
 }
 
@@ -721,7 +984,7 @@ void VITTERFASTEncoderDealloc(VITTERFASTENCODER *encoder)
 	free(encoder);
 }
 
-int VITTERFASTEncoderBytesWrite(VITTERFASTENCODER *encoder)
+long long VITTERFASTEncoderBytesWrite(VITTERFASTENCODER *encoder)
 {
 	return encoder->CurrentBytes;
 }
@@ -731,11 +994,13 @@ static int VITTERFASTDecoderInit(VITTERFASTDECODER *decoder, void *stream, int I
 	int i;
 	decoder->IsFile = IsFile;	
 	decoder->OutBits = 0;
+	decoder->weightLimit = MAX_WEIGHT;
+	memset(&decoder->stats, 0, sizeof(HUFFMANSTATS));
 	decoder->CurrentBytes = 0;
 	decoder->rack = 0;
 	decoder->mask = 0x80;
 	decoder->stream = stream;
-	decoder->hasBit = false;
+	decoder->hotLimit = 0;
 	
 	for (i = 0; i < 8; i++)
 	{
@@ -777,66 +1042,49 @@ VITTERFASTDECODER *VITTERFASTDecoderAlloc(void *stream, int IsFile)
 	return decoder;
 }
 
-static VITTERFASTTREENODE *isFeasible(int bit, VITTERFASTTREENODE *node)
+static VITTERFASTTREENODE *VITTERFASTDecoderOutputSymbol(VITTERFASTDECODER *decoder, int *symbol)
 {
-	VITTERFASTTREENODE *iter = NULL;
+	int i, depth = 0;
+	VITTERFASTTREENODE *node;
 	
-	if (bit == 0)
+#ifdef HUFFMAN_HOT_TOP
+	if (decoder->hotLimit == 0)
 	{
-		if (node->left != NULL)
-		{
-			iter = node->left;			
-		}
-	}
-	else
-	{
-		if (node->right != NULL)
-		{
-			iter = node->right;
-		}		
+		hotTopBuild(decoder);
 	}
-	return iter;
-}
-
-static VITTERFASTTREENODE *VITTERFASTDecoderOutputSymbol(VITTERFASTDECODER *decoder, int *symbol)
-{
-	int bit, i;
-	VITTERFASTTREENODE *node, *iter;
-	iter = decoder->tree->root;
 	
-	/* read in first bit of child of root*/
-	if (decoder->hasBit)
+	/* the top levels come from hotTop until a leaf or its last level */
+	i = 0;
+	while (i < (1 << VITTERFAST_HOT_LEVELS) - 1 && !(decoder->hotLeaves & (1u << i)))
 	{
-		bit = decoder->bit;
+		i = 2 * i + 1 + GetBit(decoder);
+		depth++;
 	}
-	else
+	node = decoder->hotTop[i];
+#else
+	node = decoder->tree->root;
+#endif
+	
+	/* internal nodes always have both children, so the walk stops on the
+	   leaf and reads exactly its code */
+	while (node->child[0] != NULL)
 	{
-		bit = GetBit(decoder);	
+		node = node->child[GetBit(decoder)];
+		depth++;
 	}
- 
-	while ((node = isFeasible(bit, iter)) != NULL)
+	STATS_MAX(decoder, maxDepth, depth);
+	
+	if (node->weight == 0)
 	{
-		bit = GetBit(decoder);
-		iter = node;
+		STATS_ADD(decoder, escapes, 1);
 	}
 	
-	/* need to store the last bit since this is used to decode the next symbol or read in new symbol*/
-	decoder->bit = bit;
-	decoder->hasBit = true;
-	
-	node = iter;
-	
 	if (node->weight == 0)  // zero node
 	{
 		/* read the new symbol */
-		bit = decoder->bit;
-		decoder->hasBit = false;
-		*symbol |= bit;		
-		for (i = 0; i < 7; i++)
+		for (i = 0; i < 8; i++)
 		{
-			*symbol <<= 1;
-			bit = GetBit(decoder);
-			*symbol |= bit;
+			*symbol = (*symbol << 1) | GetBit(decoder);
 		}
 	}
 	else
@@ -851,16 +1099,81 @@ int VITTERFASTDecoderDecode(VITTERFASTDECODER *decoder)
 {
 	int symbol = 0;
 	
-	VITTERFASTTREENODE *node = VITTERFASTDecoderOutputSymbol(decoder, &symbol);
+	VITTERFASTTREENODE *node;
+	
+	PROFILE_BEGIN("vitterfast.dec.input");
+	node = VITTERFASTDecoderOutputSymbol(decoder, &symbol);
+	PROFILE_END("vitterfast.dec.input");
+	STATS_ADD(decoder, symbols, 1);
 	//printf("\n");
 	//printf("symbol = %d\n", symbol);
 	
-	VITTERFASTTreeUpdate(decoder, node, symbol);	
+	if (node->weight == 0 && isExisted(decoder, symbol))
+	{
+		return VITTERFAST_END;
+	}
+	
+	PROFILE_BEGIN("vitterfast.dec.update");
+	VITTERFASTTreeUpdate(decoder, node, symbol);
+	PROFILE_END("vitterfast.dec.update");
 	//PrintVITTERFASTTree(decoder->tree->root);
 	
 	return symbol;
 }
 
+/* decode up to length symbols into output; returns how many, fewer only at
+ * the end of the stream. Node 2, the heavier child of the root, is never
+ * outweighed below the root, so coding its leaf swaps nothing and only adds
+ * to it and the root. While it is a leaf, the repeats of its one-bit code
+ * left in the byte being read are taken together with that fused update,
+ * without walking the tree */
+int VITTERFASTDecoderDecodeMany(VITTERFASTDECODER *decoder, unsigned char *output, int length)
+{
+	VITTERFASTTREENODE *root, *top;
+	int count = 0, run, symbol;
+
+	while (count < length)
+	{
+		symbol = VITTERFASTDecoderDecode(decoder);
+		if (symbol == VITTERFAST_END)
+		{
+			break;
+		}
+		output[count++] = (unsigned char)symbol;
+
+		root = decoder->tree->root;
+		top = decoder->nodeList[1];
+		if (decoder->tree->maxNumber < 3 || top->child[0] != NULL)
+		{
+			continue;
+		}
+		/* stop short of the update that halves the weights */
+		for (run = 0; count + run < length && decoder->mask != 0x80
+			&& ((decoder->rack & decoder->mask) != 0) == top->side
+			&& root->weight + run + 1 < decoder->weightLimit; run++)
+		{
+			decoder->mask >>= 1;
+			if (decoder->mask == 0)
+			{
+				decoder->mask = 0x80;
+			}
+		}
+		if (run > 0)
+		{
+			memset(output + count, top->symbol, run);
+			count += run;
+			top->weight += run;
+			root->weight += run;
+			decoder->keys[1] += 2 * run;
+			decoder->keys[0] += 2 * run;
+			STATS_ADD(decoder, symbols, run);
+			STATS_ADD(decoder, codeBits, run);
+		}
+	}
+
+	return count;
+}
+
 void VITTERFASTDecoderDealloc(VITTERFASTDECODER *decoder)
 {
 	if (decoder == NULL) return;
@@ -868,7 +1181,213 @@ void VITTERFASTDecoderDealloc(VITTERFASTDECODER *decoder)
 	free(decoder);
 }
 
-int VITTERFASTDecoderBytesRead(VITTERFASTDECODER *decoder)
+long long VITTERFASTDecoderBytesRead(VITTERFASTDECODER *decoder)
 {
 	return decoder->CurrentBytes;
-}
\ No newline at end of file
+}
+
+void VITTERFASTCoderSetWeightLimit(VITTERFASTCODER *coder, int weightLimit)
+{
+	if (weightLimit > 0 && weightLimit < MIN_WEIGHT_LIMIT)
+	{
+		weightLimit = MIN_WEIGHT_LIMIT;
+	}
+	/* 0 means no periodic halving, only the overflow guard */
+	if (weightLimit <= 0 || weightLimit > MAX_WEIGHT)
+	{
+		weightLimit = MAX_WEIGHT;
+	}
+	coder->weightLimit = weightLimit;
+}
+
+/* add k to the weight of symbol. Small k repeats the single update; larger k
+ * does one single update, adds the rest along the path to the root and 
+ * rebuilds the tree once. The result is a Huffman tree for the same weights,
+ * not always the one k single updates would give, so encoder and decoder
+ * must both use this call for the same symbols. */
+void VITTERFASTCoderUpdateBy(VITTERFASTCODER *coder, int symbol, int k)
+{
+	VITTERFASTTREENODE *node;
+
+	if (k <= VITTERFAST_BULK_UPDATE)
+	{
+		for ( ; k > 0; k--)
+		{
+			node = isExisted(coder, symbol) ? findNode(coder, symbol) : coder->tree->zeroNode;
+			VITTERFASTTreeUpdate(coder, node, symbol);
+		}
+		return;
+	}
+
+	node = isExisted(coder, symbol) ? findNode(coder, symbol) : coder->tree->zeroNode;
+	VITTERFASTTreeUpdate(coder, node, symbol);
+
+	k--;
+	if (k > MAX_WEIGHT - coder->tree->root->weight)
+	{
+		k = MAX_WEIGHT - coder->tree->root->weight;
+	}
+	for (node = findNode(coder, symbol); node != NULL; node = node->parent)
+	{
+		node->weight += k;
+	}
+	VITTERFASTTreeRebuild(coder, false);
+
+	while (coder->tree->root->weight >= coder->weightLimit)
+	{
+		VITTERFASTTreeRescale(coder);
+	}
+	
+	VITTERFAST_CHECK(coder);
+}
+
+const HUFFMANSTATS *VITTERFASTCoderStats(VITTERFASTCODER *coder)
+{
+	return &coder->stats;
+}
+
+
+/* copy the model of coder, its tree and the symbols it has seen, to state */
+void VITTERFASTCoderSaveState(VITTERFASTCODER *coder, CODERSTATE *state)
+{
+	VITTERFASTTREENODE *node;
+	int i;
+
+	state->numNodes = coder->tree->maxNumber;
+	for (i = 0; i < 8; i++)
+	{
+		state->symbolRecord[i] = coder->symbolRecord[i];
+	}
+	for (i = 0; i < coder->tree->maxNumber; i++)
+	{
+		node = coder->nodeList[i];
+		state->nodes[i].symbol = node->symbol;
+		state->nodes[i].weight = node->weight;
+		state->nodes[i].parent = (node->parent == NULL) ? 0 : node->parent->number;
+	}
+}
+
+
+/* replace the model of coder by state; the bit stream is left alone */
+/* on top of StateCheck(), Vitter's rule that the internal nodes of a weight
+ * come before its leaves, which the key scans rely on; an FGK state may
+ * break it. Returns -1 if the state breaks it */
+static int VITTERFASTStateCheck(const CODERSTATE *state)
+{
+	bool internal[STATE_MAX_NODES];
+	int i;
+
+	if (StateCheck(state) == -1)
+	{
+		return -1;
+	}
+
+	for (i = 0; i < state->numNodes; i++)
+	{
+		internal[i] = false;
+	}
+	for (i = 1; i < state->numNodes; i++)
+	{
+		internal[state->nodes[i].parent - 1] = true;
+	}
+	for (i = 1; i < state->numNodes; i++)
+	{
+		if (state->nodes[i - 1].weight == state->nodes[i].weight && !internal[i - 1] && internal[i])
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int VITTERFASTCoderLoadState(VITTERFASTCODER *coder, const CODERSTATE *state)
+{
+	VITTERFASTTREENODE *node, *parent;
+	int i;
+
+	if (VITTERFASTStateCheck(state) == -1)
+	{
+		printf("VITTERFASTCoderLoadState(): not a valid coder state.\n");
+		return -1;
+	}
+
+	VITTERFASTTreeNodesDealloc(coder->tree->root);
+	coder->tree->maxNumber = 0;
+	for (i = 0; i < state->numNodes; i++)
+	{
+		/* numbered i + 1, and the last one made is the zero node */
+		if ((node = VITTERFASTTreeNodeInit(coder)) == NULL)
+		{
+			printf("VITTERFASTCoderLoadState(): fail to allocate nodes, coder is unusable.\n");
+			return -1;
+		}
+		node->symbol = state->nodes[i].symbol;
+		node->weight = state->nodes[i].weight;
+		if (i > 0)
+		{
+			/* the left child comes first */
+			parent = coder->nodeList[state->nodes[i].parent - 1];
+			node->side = (parent->child[0] == NULL) ? 0 : 1;
+			node->parent = parent;
+			parent->child[node->side] = node;
+		}
+	}
+	coder->tree->root = coder->nodeList[0];
+	coder->hotLimit = 0;
+
+	for (i = 0; i < state->numNodes; i++)
+	{
+		coder->keys[i] = nodeKey(coder->nodeList[i]);
+	}
+	for (i = 0; i < 8; i++)
+	{
+		coder->symbolRecord[i] = state->symbolRecord[i];
+	}
+
+	VITTERFAST_CHECK(coder);
+
+	return 0;
+}
+
+
+/* bits written so far, those still waiting in the rack included */
+long long VITTERFASTEncoderBitsWrite(VITTERFASTENCODER *encoder)
+{
+	unsigned char mask;
+	int bits = 0;
+
+	for (mask = encoder->mask; mask != 0x80; mask <<= 1)
+	{
+		bits++;
+	}
+
+	return encoder->CurrentBytes * 8 + bits;
+}
+
+
+/* go on decoding at bit position bits of a stream of length bytes in
+ * memory, such as one taken by VITTERFASTEncoderBitsWrite() between two symbols */
+int VITTERFASTDecoderSeek(VITTERFASTDECODER *decoder, long long bits, long long length)
+{
+	if (decoder->IsFile)
+	{
+		printf("VITTERFASTDecoderSeek(): can only seek in a stream in memory.\n");
+		return -1;
+	}
+	if (bits < 0 || bits > length * 8)
+	{
+		printf("VITTERFASTDecoderSeek(): bit %lld is outside the stream.\n", bits);
+		return -1;
+	}
+
+	decoder->CurrentBytes = bits / 8;
+	decoder->mask = 0x80;
+	if (bits % 8 != 0)
+	{
+		decoder->rack = GetByte(decoder->stream, &(decoder->CurrentBytes), decoder->IsFile);
+		decoder->mask = 0x80 >> (bits % 8);
+	}
+
+	return 0;
+}
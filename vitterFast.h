@@ -12,16 +12,23 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include "stats.h"
+#include "state.h"
+#include "weight.h"
 
 #define NUM_BITS_IN_INT      32
+#define VITTERFAST_END       256	/* decoded the end of the stream */
+#define VITTERFAST_BULK_UPDATE 16	/* larger increments rebuild the tree once */
+#define VITTERFAST_HOT_LEVELS 4	/* levels below the root a decoder walks in hotTop, at most 4 for hotLeaves */
+#define VITTERFAST_HOT_SIZE  ((2 << VITTERFAST_HOT_LEVELS) - 1)
 
 typedef struct VITTERFASTNode
 {
 	int symbol;
 	int weight;
 	int number;
-	bool isLeft;
-	struct VITTERFASTNode *parent, *left, *right;
+	int side;	/* 0 if left child, 1 if right child */
+	struct VITTERFASTNode *parent, *child[2];	/* left, right */
 }VITTERFASTTREENODE;
 
 typedef struct
@@ -34,15 +41,20 @@ typedef struct
 typedef struct 
 {
 	int IsFile;	
-    int rack, value, CurrentBytes;
+    int rack, value;
+	long long CurrentBytes;
 	int InBits, OutBits;
 	int symbolRecord[8];
-	int bit;
-	bool hasBit;
+	int weightLimit;	/* root weight at which all weights are halved */
+	HUFFMANSTATS stats;	/* counted with HUFFMAN_STATS */
 	unsigned char mask;
 	void *stream;
 	VITTERFASTTREE *tree;
 	VITTERFASTTREENODE *nodeList[513];
+	unsigned int keys[513];	/* 2 * weight + 1 if a leaf, of nodeList[i], dense for the block scans */
+	VITTERFASTTREENODE *hotTop[VITTERFAST_HOT_SIZE];	/* nodes of the top levels in heap order, NULL below a leaf */
+	unsigned int hotLeaves;	/* bit i set if hotTop[i] is a leaf */
+	int hotLimit;	/* highest number in hotTop, 0 when hotTop must be rebuilt */
 } VITTERFASTENCODER, VITTERFASTDECODER, VITTERFASTCODER;
 
 
@@ -51,11 +63,20 @@ typedef struct
 void VITTERFASTEncoderFlush(VITTERFASTENCODER *encoder);
 VITTERFASTENCODER *VITTERFASTEncoderAlloc(void *stream, int IsFile);
 void VITTERFASTEncoderEncode(VITTERFASTENCODER *encoder, int symbol);
+void VITTERFASTEncoderEnd(VITTERFASTENCODER *encoder);
 void VITTERFASTEncoderDealloc(VITTERFASTENCODER *encoder);
-int VITTERFASTEncoderBytesWrite(VITTERFASTDECODER *encoder);
-VITTERFASTDECODER *VITTERFASTDEcoderAlloc(void *stream, int IsFile);
+long long VITTERFASTEncoderBytesWrite(VITTERFASTDECODER *encoder);
+VITTERFASTDECODER *VITTERFASTDecoderAlloc(void *stream, int IsFile);
 int VITTERFASTDecoderDecode(VITTERFASTDECODER *decoder);
+int VITTERFASTDecoderDecodeMany(VITTERFASTDECODER *decoder, unsigned char *output, int length);
 void VITTERFASTDecoderDealloc(VITTERFASTDECODER *decoder);
-int VITTERFASTDecoderBytesRead(VITTERFASTDECODER *decoder);
+long long VITTERFASTDecoderBytesRead(VITTERFASTDECODER *decoder);
+void VITTERFASTCoderSetWeightLimit(VITTERFASTCODER *coder, int weightLimit);
+const HUFFMANSTATS *VITTERFASTCoderStats(VITTERFASTCODER *coder);
+void VITTERFASTCoderUpdateBy(VITTERFASTCODER *coder, int symbol, int k);
+void VITTERFASTCoderSaveState(VITTERFASTCODER *coder, CODERSTATE *state);
+int VITTERFASTCoderLoadState(VITTERFASTCODER *coder, const CODERSTATE *state);
+long long VITTERFASTEncoderBitsWrite(VITTERFASTENCODER *encoder);
+int VITTERFASTDecoderSeek(VITTERFASTDECODER *decoder, long long bits, long long length);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,17 @@
+/*************************************************************************
+ *
+ *	File:	weight.h
+ *	Author:  Jing Huang & Liang Wu
+ *
+ *	Description: bounds on the weight limit, shared by every tree engine.
+ *  Tree weights are int, and the root holds the sum of all of them.
+ *
+ ************************************************************************/
+
+#ifndef __WEIGHT_H_
+#define __WEIGHT_H_
+
+#define MIN_WEIGHT_LIMIT     1024	/* halving below this would leave too little room for 256 symbols */
+#define MAX_WEIGHT           0x40000000	/* weights are always halved here, so int sums cannot overflow */
+
+#endif